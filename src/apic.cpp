@@ -0,0 +1,292 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// Local APIC and IO-APIC support, found through the ACPI MADT. Used by
+// interrupts.cpp instead of the 8259 PICs when the machine has them.
+
+// Local APIC registers (byte offsets)
+#define LAPIC_ID 0x020
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_SVR_ENABLE 0x100
+
+#define MSR_APIC_BASE 0x1B
+#define MSR_APIC_BASE_ENABLE (1u << 11)
+
+// IO-APIC registers
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIR 0x10
+
+// Redirection entry bits
+#define IOAPIC_ACTIVE_LOW (1u << 13)
+#define IOAPIC_LEVEL (1u << 15)
+#define IOAPIC_MASKED (1u << 16)
+
+// MADT entry types
+#define MADT_IOAPIC 1
+#define MADT_OVERRIDE 2
+
+// MPS INTI flags in an interrupt source override
+#define MADT_POLARITY_MASK 0x3
+#define MADT_POLARITY_LOW 0x3
+#define MADT_TRIGGER_MASK 0xC
+#define MADT_TRIGGER_LEVEL 0xC
+
+#define CPUID_APIC (1u << 9)
+
+#define APIC_ISA_IRQS 16
+
+// Routing bookkeeping: flag for IRQs moved by an override (never written
+// to the IO-APIC) and the pin of an IRQ that has none
+#define APIC_OVERRIDDEN (1u << 31)
+#define APIC_NO_PIN 0xFFFFFFFFu
+
+struct AcpiRsdp {
+    char signature[8];          // "RSD PTR "
+    vic_uint8 checksum;
+    char oem_id[6];
+    vic_uint8 revision;
+    vic_uint32 rsdt_address;
+} __attribute__((packed));
+
+struct AcpiHeader {
+    char signature[4];
+    vic_uint32 length;
+    vic_uint8 revision;
+    vic_uint8 checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    vic_uint32 oem_revision;
+    vic_uint32 creator_id;
+    vic_uint32 creator_revision;
+} __attribute__((packed));
+
+struct AcpiMadt {
+    AcpiHeader header;
+    vic_uint32 lapic_address;
+    vic_uint32 flags;
+} __attribute__((packed));
+
+struct MadtEntry {
+    vic_uint8 type;
+    vic_uint8 length;
+} __attribute__((packed));
+
+struct MadtIoApic {
+    MadtEntry entry;
+    vic_uint8 id;
+    vic_uint8 reserved;
+    vic_uint32 address;
+    vic_uint32 gsi_base;
+} __attribute__((packed));
+
+struct MadtOverride {
+    MadtEntry entry;
+    vic_uint8 bus;
+    vic_uint8 source;           // ISA IRQ
+    vic_uint32 gsi;
+    vic_uint16 flags;
+} __attribute__((packed));
+
+volatile vic_uint32* apic_lapic = nullptr;
+volatile vic_uint32* apic_ioapic = nullptr;
+vic_uint32 apic_ioapic_pins = 0;
+vic_uint8 apic_vector_base = 0;
+
+// ISA IRQ routing: input pin and redirection flags
+vic_uint32 apic_irq_gsi[APIC_ISA_IRQS];
+vic_uint32 apic_irq_flags[APIC_ISA_IRQS];
+
+static bool apic_checksum_ok(const void* data, vic_uint32 len) {
+    const vic_uint8* bytes = (const vic_uint8*)data;
+    vic_uint8 sum = 0;
+    for (vic_uint32 i = 0; i < len; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+static bool apic_signature(const char* have, const char* want, int len) {
+    for (int i = 0; i < len; i++) {
+        if (have[i] != want[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Look for the RSDP on 16-byte boundaries in [start, end)
+static const AcpiRsdp* apic_scan_rsdp(vic_uint32 start, vic_uint32 end) {
+    for (vic_uint32 addr = start; addr + sizeof(AcpiRsdp) <= end; addr += 16) {
+        const AcpiRsdp* rsdp = (const AcpiRsdp*)(vic_uintptr)addr;
+        if (apic_signature(rsdp->signature, "RSD PTR ", 8) &&
+            apic_checksum_ok(rsdp, sizeof(AcpiRsdp))) {
+            return rsdp;
+        }
+    }
+    return nullptr;
+}
+
+static const AcpiMadt* apic_find_madt() {
+    // First KiB of the EBDA, then the BIOS area
+    vic_uint32 ebda = (vic_uint32)(*(volatile vic_uint16*)0x40E) << 4;
+    const AcpiRsdp* rsdp = ebda ? apic_scan_rsdp(ebda, ebda + 1024) : nullptr;
+    if (!rsdp) {
+        rsdp = apic_scan_rsdp(0xE0000, 0x100000);
+    }
+    if (!rsdp) {
+        return nullptr;
+    }
+
+    const AcpiHeader* rsdt = (const AcpiHeader*)(vic_uintptr)rsdp->rsdt_address;
+    if (!rsdt || !apic_signature(rsdt->signature, "RSDT", 4) ||
+        !apic_checksum_ok(rsdt, rsdt->length)) {
+        return nullptr;
+    }
+
+    const vic_uint32* tables = (const vic_uint32*)(rsdt + 1);
+    vic_uint32 count = (rsdt->length - sizeof(AcpiHeader)) / 4;
+    for (vic_uint32 i = 0; i < count; i++) {
+        const AcpiHeader* table = (const AcpiHeader*)(vic_uintptr)tables[i];
+        if (apic_signature(table->signature, "APIC", 4) &&
+            apic_checksum_ok(table, table->length)) {
+            return (const AcpiMadt*)table;
+        }
+    }
+    return nullptr;
+}
+
+static vic_uint32 apic_ioapic_read(vic_uint32 reg) {
+    apic_ioapic[IOAPIC_REGSEL / 4] = reg;
+    return apic_ioapic[IOAPIC_WIN / 4];
+}
+
+static void apic_ioapic_write(vic_uint32 reg, vic_uint32 value) {
+    apic_ioapic[IOAPIC_REGSEL / 4] = reg;
+    apic_ioapic[IOAPIC_WIN / 4] = value;
+}
+
+static void apic_lapic_write(vic_uint32 reg, vic_uint32 value) {
+    apic_lapic[reg / 4] = value;
+}
+
+// Program the redirection entry of an ISA IRQ
+static void apic_route(vic_uint8 irq, bool masked) {
+    vic_uint32 gsi = apic_irq_gsi[irq];
+    if (gsi >= apic_ioapic_pins) {
+        return;
+    }
+
+    vic_uint32 dest = apic_lapic[LAPIC_ID / 4] & 0xFF000000;
+    vic_uint32 low = (apic_vector_base + irq) | apic_irq_flags[irq];
+    if (masked) {
+        low |= IOAPIC_MASKED;
+    }
+    apic_ioapic_write(IOAPIC_REDIR + gsi * 2 + 1, dest);
+    apic_ioapic_write(IOAPIC_REDIR + gsi * 2, low);
+}
+
+// Switch interrupt delivery to the local APIC and IO-APIC, routing ISA
+// IRQ n to vector_base + n (all masked) and unused vectors to spurious.
+// Returns false, leaving things untouched, when there is no APIC or MADT.
+bool apic_init(vic_uint8 vector_base, vic_uint8 spurious_vector) {
+    vic_uint32 a, b, c, d;
+    asm volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+    if (!(d & CPUID_APIC)) {
+        return false;
+    }
+
+    const AcpiMadt* madt = apic_find_madt();
+    if (!madt) {
+        return false;
+    }
+
+    // ISA IRQs are identity mapped, edge-triggered and active high unless
+    // an override says otherwise
+    for (vic_uint32 i = 0; i < APIC_ISA_IRQS; i++) {
+        apic_irq_gsi[i] = i;
+        apic_irq_flags[i] = 0;
+    }
+
+    const MadtIoApic* ioapic = nullptr;
+    vic_uint32 pos = sizeof(AcpiMadt);
+    while (pos + sizeof(MadtEntry) <= madt->header.length) {
+        const MadtEntry* entry = (const MadtEntry*)((const vic_uint8*)madt + pos);
+        if (entry->length < sizeof(MadtEntry)) {
+            break;
+        }
+
+        if (entry->type == MADT_IOAPIC && !ioapic) {
+            const MadtIoApic* io = (const MadtIoApic*)entry;
+            if (io->gsi_base == 0) {
+                ioapic = io;
+            }
+        } else if (entry->type == MADT_OVERRIDE) {
+            const MadtOverride* over = (const MadtOverride*)entry;
+            if (over->bus == 0 && over->source < APIC_ISA_IRQS) {
+                vic_uint32 flags = 0;
+                if ((over->flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW) {
+                    flags |= IOAPIC_ACTIVE_LOW;
+                }
+                if ((over->flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) {
+                    flags |= IOAPIC_LEVEL;
+                }
+                apic_irq_gsi[over->source] = over->gsi;
+                apic_irq_flags[over->source] = flags | APIC_OVERRIDDEN;
+            }
+        }
+        pos += entry->length;
+    }
+    if (!ioapic) {
+        return false;
+    }
+
+    // An override takes its pin away from the IRQ identity mapped there
+    // (usually the timer moving to pin 2, the old cascade)
+    for (vic_uint32 i = 0; i < APIC_ISA_IRQS; i++) {
+        if (!(apic_irq_flags[i] & APIC_OVERRIDDEN)) {
+            continue;
+        }
+        for (vic_uint32 j = 0; j < APIC_ISA_IRQS; j++) {
+            if (j != i && apic_irq_gsi[j] == apic_irq_gsi[i] &&
+                !(apic_irq_flags[j] & APIC_OVERRIDDEN)) {
+                apic_irq_gsi[j] = APIC_NO_PIN;
+            }
+        }
+    }
+    for (vic_uint32 i = 0; i < APIC_ISA_IRQS; i++) {
+        apic_irq_flags[i] &= ~APIC_OVERRIDDEN;
+    }
+
+    apic_lapic = (volatile vic_uint32*)(vic_uintptr)madt->lapic_address;
+    apic_ioapic = (volatile vic_uint32*)(vic_uintptr)ioapic->address;
+    apic_ioapic_pins = ((apic_ioapic_read(IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+    apic_vector_base = vector_base;
+
+    // Globally enable the local APIC, then software-enable it
+    vic_uint32 lo, hi;
+    asm volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_APIC_BASE));
+    asm volatile ("wrmsr" : : "a"(lo | MSR_APIC_BASE_ENABLE), "d"(hi), "c"(MSR_APIC_BASE));
+    apic_lapic_write(LAPIC_TPR, 0);
+    apic_lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | spurious_vector);
+
+    // Mask every input; ISA IRQs are routed as handlers register
+    for (vic_uint32 gsi = 0; gsi < apic_ioapic_pins; gsi++) {
+        apic_ioapic_write(IOAPIC_REDIR + gsi * 2, IOAPIC_MASKED);
+    }
+    return true;
+}
+
+void apic_set_mask(vic_uint8 irq, bool masked) {
+    if (apic_ioapic && irq < APIC_ISA_IRQS) {
+        apic_route(irq, masked);
+    }
+}
+
+void apic_eoi() {
+    apic_lapic_write(LAPIC_EOI, 0);
+}
@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "arena.h"
+
+void arena_init(Arena* arena, void* memory, vic_uint32 size) {
+    arena->base = (vic_uint8*)memory;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+void* arena_alloc(Arena* arena, vic_uint32 size) {
+    vic_uint32 start = (arena->used + 7) & ~7u;
+    if (start > arena->size || size > arena->size - start) {
+        return nullptr;
+    }
+
+    arena->used = start + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return arena->base + start;
+}
+
+char* arena_strndup(Arena* arena, const char* str, vic_uint32 len) {
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    if (!copy) {
+        return nullptr;
+    }
+
+    for (vic_uint32 i = 0; i < len; i++) {
+        copy[i] = str[i];
+    }
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_reset(Arena* arena) {
+    arena->used = 0;
+}
@@ -0,0 +1,28 @@
+// src/arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// Bump-pointer allocator over a fixed buffer. Allocations are never freed
+// one by one; arena_reset drops them all at once.
+struct Arena {
+    vic_uint8* base;
+    vic_uint32 size;
+    vic_uint32 used;
+    vic_uint32 peak;        // Highest used since arena_init
+};
+
+void arena_init(Arena* arena, void* memory, vic_uint32 size);
+
+// Returns 8-byte aligned memory, or null when the arena is full
+void* arena_alloc(Arena* arena, vic_uint32 size);
+
+// Copy len bytes of str and terminate them
+char* arena_strndup(Arena* arena, const char* str, vic_uint32 len);
+
+void arena_reset(Arena* arena);
+
+#endif // ARENA_H
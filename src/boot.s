@@ -1,9 +1,13 @@
 ; Multiboot header
+MB_PAGE_ALIGN equ 1 << 0    ; Load modules on page boundaries
+MB_MEMORY_INFO equ 1 << 1   ; Ask for mem_lower/mem_upper and the memory map
+MB_FLAGS equ MB_PAGE_ALIGN | MB_MEMORY_INFO
+
 section .multiboot
 align 4
-    dd 0x1BADB002           ; magic
-    dd 0x00                 ; flags
-    dd -(0x1BADB002 + 0x00) ; checksum
+    dd 0x1BADB002               ; magic
+    dd MB_FLAGS                 ; flags
+    dd -(0x1BADB002 + MB_FLAGS) ; checksum
 
 section .text
 global _start
@@ -13,7 +17,10 @@ _start:
     ; Set up the stack
     mov esp, stack_top
 
-    ; Call kernel_main
+    ; Call kernel_main(magic, multiboot info) - the bootloader left the
+    ; magic in eax and the info address in ebx
+    push ebx
+    push eax
     call kernel_main
 
     ; Hang if kernel_main returns
@@ -24,6 +31,8 @@ _start:
 
 section .bss
 align 16
+global stack_bottom
+global stack_top
 stack_bottom:
     resb 16384 ; 16 KiB
 stack_top:
@@ -1,6 +1,9 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "timer.h"
+#include "sched.h"
+#include "interrupts.h"
 
 // Forward declarations
 void kprint(const char* str);
@@ -50,6 +53,10 @@ static inline void outsw(vic_uint16 port, void* addr, vic_size_t count) {
 #define ATA_SECONDARY_STATUS      0x177
 #define ATA_SECONDARY_COMMAND     0x177
 
+// Device control registers; writing 0 clears nIEN so drives raise IRQs
+#define ATA_PRIMARY_CONTROL       0x3F6
+#define ATA_SECONDARY_CONTROL     0x376
+
 // ATA commands
 #define ATA_CMD_READ_SECTORS      0x20
 #define ATA_CMD_WRITE_SECTORS     0x30
@@ -75,6 +82,13 @@ static inline void outsw(vic_uint16 port, void* addr, vic_size_t count) {
 #define ATA_ER_TK0NF 0x02  // Track 0 not found
 #define ATA_ER_AMNF  0x01  // Address mark not found
 
+// How long a drive may stay busy before we give up on it
+#define ATA_TIMEOUT_NS (30 * TIMER_NS_PER_SEC)
+
+// Longest sleep between status polls while waiting for an IRQ; covers
+// states the drive does not interrupt for, such as BSY after a reset
+#define ATA_POLL_NS (10 * TIMER_NS_PER_MS)
+
 // Drive select bits
 #define ATA_MASTER   0xA0
 #define ATA_SLAVE    0xB0
@@ -93,40 +107,93 @@ struct DriveInfo {
 DriveInfo detected_drives[MAX_DRIVES];
 int active_drive = 0;  // Currently active drive
 
-// Wait for BSY to clear
-bool ata_wait_not_busy(vic_uint16 base_port) {
-    // Wait up to 30 seconds for drive to be ready
-    for (int i = 0; i < 30000; i++) {
-        vic_uint8 status = inb(base_port + 7);  // STATUS register
-        if (!(status & ATA_SR_BSY)) {
+// Set by the IRQ 14/15 handlers and the poll timer; a waiter clears it
+// before each status read, so an IRQ after that read is not missed
+static volatile bool ata_event = false;
+static bool ata_irq_enabled = false;
+static WaitQueue ata_waiters;
+static Timer ata_poll_timer;
+
+static bool ata_has_event() {
+    return ata_event;
+}
+
+static void ata_wake(void* /* data */) {
+    ata_event = true;
+    sched_wake(&ata_waiters);
+}
+
+// Reading the status register acknowledges the drive's interrupt
+static void ata_primary_irq() {
+    inb(ATA_PRIMARY_STATUS);
+    ata_wake(nullptr);
+}
+
+static void ata_secondary_irq() {
+    inb(ATA_SECONDARY_STATUS);
+    ata_wake(nullptr);
+}
+
+// Wait until (status & mask) == value, or the drive reports an error
+// Once threads are running this sleeps until an IRQ or the poll timer
+// (a tick at a time without IRQs); before that it spins politely
+// Returns false if the drive stayed busy past ATA_TIMEOUT_NS
+static bool ata_wait(vic_uint16 base_port, vic_uint8 mask, vic_uint8 value, vic_uint8* status) {
+    vic_uint64 deadline = ktime_ns() + ATA_TIMEOUT_NS;
+    for (;;) {
+        ata_event = false;
+        *status = inb(base_port + 7);  // STATUS register
+        if ((*status & mask) == value ||
+            (!(*status & ATA_SR_BSY) && (*status & ATA_SR_ERR))) {
             return true;
         }
 
-        // Short delay
-        for (int j = 0; j < 10000; j++) {
-            asm volatile("nop");
+        vic_uint64 now = ktime_ns();
+        if (now >= deadline) {
+            return false;
+        }
+        if (!sched_running()) {
+            asm volatile("pause");
+            continue;
+        }
+        if (!ata_irq_enabled) {
+            sched_sleep_ns(TIMER_TICK_NS);
+            continue;
+        }
+
+        vic_uint64 delay = deadline - now;
+        if (delay > ATA_POLL_NS) {
+            delay = ATA_POLL_NS;
         }
+        timer_start(&ata_poll_timer, delay, 0, ata_wake, nullptr);
+        sched_wait(&ata_waiters, ata_has_event);
+        timer_cancel(&ata_poll_timer);
     }
+}
 
-    return false;
+// Wait for BSY to clear
+bool ata_wait_not_busy(vic_uint16 base_port) {
+    vic_uint8 status;
+    return ata_wait(base_port, ATA_SR_BSY, 0, &status);
 }
 
 // Wait for DRQ to set
 bool ata_wait_drq(vic_uint16 base_port) {
-    // Wait up to 30 seconds for drive to be ready
-    for (int i = 0; i < 30000; i++) {
-        vic_uint8 status = inb(base_port + 7);  // STATUS register
-        if (status & ATA_SR_DRQ) {
-            return true;
-        }
+    vic_uint8 status;
+    return ata_wait(base_port, ATA_SR_DRQ, ATA_SR_DRQ, &status) && (status & ATA_SR_DRQ);
+}
 
-        // Short delay
-        for (int j = 0; j < 10000; j++) {
-            asm volatile("nop");
-        }
+// Take both channels' IRQs so waits can sleep instead of poll
+static void ata_enable_irq() {
+    if (ata_irq_enabled) {
+        return;
     }
+    outb(ATA_PRIMARY_CONTROL, 0);
+    outb(ATA_SECONDARY_CONTROL, 0);
 
-    return false;
+    bool primary = (irq_register(IRQ_ATA_PRIMARY, ata_primary_irq) == 0);
+    bool secondary = (irq_register(IRQ_ATA_SECONDARY, ata_secondary_irq) == 0);
+    ata_irq_enabled = primary && secondary;
 }
 
 // Identify a drive
@@ -159,21 +226,11 @@ bool ata_identify(vic_uint16 base_port, vic_uint8 drive_select, DriveInfo* drive
     }
 
     // Wait for data to be ready or for an error
-    bool error = false;
-    while (1) {
-        status = inb(base_port + 7);  // STATUS register
-
-        if (status & ATA_SR_ERR) {
-            error = true;
-            break;
-        }
-
-        if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) {
-            break;
-        }
+    if (!ata_wait(base_port, ATA_SR_BSY | ATA_SR_DRQ, ATA_SR_DRQ, &status)) {
+        return false;
     }
 
-    if (error) {
+    if (status & ATA_SR_ERR) {
         // Check if it might be an ATAPI device
         vic_uint8 cl = inb(base_port + 4);  // LBA MID
         vic_uint8 ch = inb(base_port + 5);  // LBA HI
@@ -309,6 +366,7 @@ void num_to_str(vic_uint32 num, char* str) {
 // Disk initialization
 int disk_initialize() {
     kprint("Initializing disk subsystem...\n");
+    ata_enable_irq();
 
     // Detect all drives
     detect_all_drives();
@@ -3,35 +3,9 @@
 #include <stddef.h>
 #include "fatfs_integration.h"
 
-extern "C" {
-    void fatfs_init();
-    FRESULT fatfs_mkdir(const char* path);
-    FRESULT fatfs_write_file(const char* path, const char* content, vic_size_t len);
-    FRESULT fatfs_read_file(const char* path, char* buffer, vic_size_t buffer_size, vic_size_t* bytes_read);
-    FRESULT fatfs_ls(const char* path);
-    FRESULT fatfs_cd(const char* path);
-    FRESULT fatfs_pwd(char* buffer, vic_size_t size);
-}
-
-// Forward declaration of FatFs types without including headers
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-struct FATFS;
-extern struct FATFS g_fatfs;
-
-#ifdef __cplusplus
-}
-#endif
-
 // Forward declarations for VicOS functions
-extern "C" {
-    void kprint(const char* str);
-    int disk_read_sector(vic_uint32 lba, vic_uint8* buffer);
-    int disk_write_sector(vic_uint32 lba, const vic_uint8* buffer);
-    int get_partition_info(int partition_num, vic_uint32* start_lba, vic_uint32* sector_count);
-}
+void kprint(const char* str);
+int get_partition_info(int partition_num, vic_uint32* start_lba, vic_uint32* sector_count);
 
 // String/memory implementations
 void fat_strcpy(char* dest, const char* src) {
@@ -56,8 +30,9 @@ void fat_memcpy(void* dest, const void* src, vic_size_t num) {
     }
 }
 
-// Create FAT32 FS
-int create_fat32_filesystem() {
+// Format partition 1 with FatFs
+static int create_filesystem(int use_exfat) {
+    const char* fs_name = use_exfat ? "exFAT" : "FAT32";
     vic_uint32 partition_start, partition_size;
 
     if (get_partition_info(1, &partition_start, &partition_size) < 0) {
@@ -65,14 +40,30 @@ int create_fat32_filesystem() {
         return -1;
     }
 
-    kprint("Creating FAT32 filesystem on partition 1...\n");
+    kprint("Creating ");
+    kprint(fs_name);
+    kprint(" filesystem on partition 1...\n");
 
-    fatfs_init();
+    if (fatfs_format(use_exfat) < 0) {
+        kprint("Failed to format partition 1\n");
+        return -1;
+    }
 
-    kprint("FAT32 filesystem created successfully\n");
+    kprint(fs_name);
+    kprint(" filesystem created successfully\n");
     return 0;
 }
 
+// Create FAT32 FS
+int create_fat32_filesystem() {
+    return create_filesystem(0);
+}
+
+// Create exFAT FS - no 4 GiB file size limit, bitmap cluster allocation
+int create_exfat_filesystem() {
+    return create_filesystem(1);
+}
+
 // Create directory
 int create_directory(const char* dirname) {
     FRESULT res = fatfs_mkdir(dirname);
@@ -106,58 +97,3 @@ int create_file_with_content(const char* filename, const void* data, vic_size_t
     kprint("\n");
     return 0;
 }
-
-// Read file
-const char* read_file_content(const char* filename, char* buffer, vic_size_t buffer_size) {
-    vic_size_t bytes_read = 0;
-    FRESULT res = fatfs_read_file(filename, buffer, buffer_size, &bytes_read);
-
-    if (res != FR_OK) {
-        kprint("Failed to read file: ");
-        kprint(filename);
-        kprint("\n");
-        return nullptr;
-    }
-
-    return buffer;
-}
-
-// List directory
-int list_directory(const char* path) {
-    FRESULT res = fatfs_ls(path);
-
-    if (res != FR_OK) {
-        kprint("Failed to list directory: ");
-        kprint(path);
-        kprint("\n");
-        return -1;
-    }
-
-    return 0;
-}
-
-// Change directory
-int change_directory(const char* path) {
-    FRESULT res = fatfs_cd(path);
-
-    if (res != FR_OK) {
-        kprint("Failed to change directory: ");
-        kprint(path);
-        kprint("\n");
-        return -1;
-    }
-
-    return 0;
-}
-
-// Get current directory
-const char* get_current_directory(char* buffer, vic_size_t buffer_size) {
-    FRESULT res = fatfs_pwd(buffer, buffer_size);
-
-    if (res != FR_OK) {
-        kprint("Failed to get current directory\n");
-        return nullptr;
-    }
-
-    return buffer;
-}
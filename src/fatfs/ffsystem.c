@@ -10,15 +10,18 @@
 /*------------------------------------------------------------------------*/
 /* Allocate/Free a Memory Block                                           */
 /*------------------------------------------------------------------------*/
+/* FatFs working buffers (LFN name buffer, directory clear buffer) come
+/  from the kernel heap (kheap.cpp).
+*/
 
-#include <stdlib.h>		/* with POSIX API */
+#include "kheap.h"
 
 
 void* ff_memalloc (	/* Returns pointer to the allocated memory block (null if not enough core) */
 	UINT msize		/* Number of bytes to allocate */
 )
 {
-	return malloc((vic_size_t)msize);	/* Allocate a new memory block */
+	return kmalloc(msize);	/* Allocate a new memory block */
 }
 
 
@@ -26,7 +29,7 @@ void ff_memfree (
 	void* mblock	/* Pointer to the memory block to free (no effect if null) */
 )
 {
-	free(mblock);	/* Free the memory block */
+	kfree(mblock);	/* Free the memory block */
 }
 
 #endif
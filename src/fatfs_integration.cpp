@@ -1,23 +1,46 @@
 // fatfs_integration.cpp
 
-#include <cstring>
-#include <cstdio>
-
 // VERY IMPORTANT: wrap C headers correctly
 #include "ff.h"
 #include "diskio.h"
+#include "vfs.h"
+#include "kheap.h"
 
 
-// Define our low-level disk functions that interact with the hardware
-extern "C" {
-    int disk_read_sector(unsigned long long sector, unsigned char* buffer);
-    int disk_write_sector(unsigned long long sector, const unsigned char* buffer);
-    unsigned long long get_partition_info();
-}
+// Low-level disk functions from disk_driver.cpp (ATA, active drive)
+int disk_initialize();
+int disk_read_sector(vic_uint32 lba, vic_uint8* buffer);
+int disk_write_sector(vic_uint32 lba, const vic_uint8* buffer);
+vic_uint32 disk_get_size();
 
 // Buffer sector size
 #define SECTOR_SIZE 512
 
+// Bytes handed to f_forward per call when streaming a file
+#define FATFS_STREAM_CHUNK 4096
+
+// Working buffer for f_mkfs - bigger means fewer, larger writes while formatting
+#define FATFS_MKFS_WORK_SIZE 4096
+
+// Logical volume to partition mapping: volume 0 is partition 1 on drive 0
+PARTITION VolToPart[FF_VOLUMES] = {
+    {0, 1},
+    {0, 2}
+};
+
+static BYTE mkfs_work[FATFS_MKFS_WORK_SIZE];
+
+// Volume 0 work area, registered by mount or right after formatting
+static FATFS fatfs_volume;
+
+// Slab caches for the open file/directory objects backing VFS vnodes and
+// directory descriptors, created on first use
+static KmemCache* fatfs_file_cache = nullptr;
+static KmemCache* fatfs_dir_cache = nullptr;
+
+// Sink of the stream in progress (f_forward takes a plain function)
+static VfsSink fatfs_active_sink = nullptr;
+
 // Return disk status
 DSTATUS disk_status(BYTE pdrv) {
     if (pdrv != 0) return STA_NOINIT;
@@ -35,7 +58,7 @@ DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
     if (pdrv != 0) return RES_PARERR;
 
     for (UINT i = 0; i < count; ++i) {
-        if (disk_read_sector(sector + i, buff + (i * SECTOR_SIZE)) != 0) {
+        if (disk_read_sector((vic_uint32)(sector + i), buff + (i * SECTOR_SIZE)) != 0) {
             return RES_ERROR;
         }
     }
@@ -48,7 +71,7 @@ DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
     if (pdrv != 0) return RES_PARERR;
 
     for (UINT i = 0; i < count; ++i) {
-        if (disk_write_sector(sector + i, buff + (i * SECTOR_SIZE)) != 0) {
+        if (disk_write_sector((vic_uint32)(sector + i), buff + (i * SECTOR_SIZE)) != 0) {
             return RES_ERROR;
         }
     }
@@ -70,9 +93,467 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
             *(DWORD*)buff = 1; // Erase block size in sectors (can tune later)
             return RES_OK;
         case GET_SECTOR_COUNT:
-            *(LBA_t*)buff = get_partition_info();
+            *(LBA_t*)buff = disk_get_size();
             return RES_OK;
         default:
             return RES_PARERR;
     }
-}
\ No newline at end of file
+}
+
+// Format volume 0 as FAT32 or exFAT
+// Returns 0 on success, -1 on failure
+extern "C" int fatfs_format(int use_exfat) {
+    MKFS_PARM opt = {
+        (BYTE)(use_exfat ? FM_EXFAT : FM_FAT32),
+        0,  // Number of FATs: default
+        0,  // Data area alignment: from disk_ioctl
+        0,  // Root directory entries: FAT12/16 only
+        0   // Cluster size: chosen by volume size
+    };
+
+    if (f_mkfs("0:", &opt, mkfs_work, sizeof(mkfs_work)) != FR_OK) {
+        return -1;
+    }
+
+    // Register the fresh volume so the installer can populate it
+    return (f_mount(&fatfs_volume, "0:", 0) == FR_OK) ? 0 : -1;
+}
+
+// Create a directory on volume 0
+extern "C" FRESULT fatfs_mkdir(const char* path) {
+    return f_mkdir(path);
+}
+
+// Create or replace a file with the given content
+// The file is preallocated as one contiguous run first. On exFAT that marks
+// it NoFatChain, so later reads and appends never walk the FAT.
+extern "C" FRESULT fatfs_write_file(const char* path, const char* content, vic_size_t len) {
+    FIL file;
+    UINT written;
+
+    FRESULT res = f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res != FR_OK) {
+        return res;
+    }
+
+    if (len > 0) {
+        // Best effort: on a fragmented volume f_write builds a normal chain
+        f_expand(&file, len, 1);
+
+        res = f_write(&file, content, len, &written);
+        if (res == FR_OK && written != len) {
+            res = FR_DENIED; // Volume full
+        }
+    }
+
+    FRESULT close_res = f_close(&file);
+    return (res != FR_OK) ? res : close_res;
+}
+
+// Binary-safe file data access on volume 0, mirroring fs_read/fs_write/
+// fs_append on the RAM filesystem. count receives the bytes transferred.
+
+// Zeros for filling the gap when a file grows past its end
+static const BYTE fatfs_zeros[512] = {0};
+
+// Grow a file to size with zeros; f_lseek alone would extend it with
+// whatever the new clusters held
+static FRESULT fatfs_zero_extend(FIL* file, vic_uint32 size) {
+    FRESULT res = f_lseek(file, f_size(file));
+    while (res == FR_OK && f_size(file) < size) {
+        vic_uint32 gap = size - (vic_uint32)f_size(file);
+        UINT done;
+        res = f_write(file, fatfs_zeros, gap > sizeof(fatfs_zeros) ? sizeof(fatfs_zeros) : gap, &done);
+        if (res == FR_OK && done == 0) {
+            res = FR_DENIED; // Volume full
+        }
+    }
+    return res;
+}
+
+// Read up to len bytes at offset
+extern "C" FRESULT fatfs_read(const char* path, vic_uint32 offset, void* buf, vic_uint32 len,
+                              vic_uint32* count) {
+    FIL file;
+    UINT done = 0;
+
+    FRESULT res = f_open(&file, path, FA_READ);
+    if (res != FR_OK) {
+        return res;
+    }
+
+    if (offset < f_size(&file)) {
+        res = f_lseek(&file, offset);
+        if (res == FR_OK) {
+            res = f_read(&file, buf, len, &done);
+        }
+    }
+    *count = done;
+
+    FRESULT close_res = f_close(&file);
+    return (res != FR_OK) ? res : close_res;
+}
+
+// Write len bytes to an open file at offset, zero-filling any hole
+static FRESULT fatfs_write_at(FIL* file, vic_uint32 offset, const void* buf, vic_uint32 len,
+                              vic_uint32* count) {
+    UINT done;
+    FRESULT res = fatfs_zero_extend(file, offset);
+
+    *count = 0;
+    if (res == FR_OK) {
+        res = f_lseek(file, offset);
+    }
+    if (res == FR_OK) {
+        res = f_write(file, buf, len, &done);
+        *count = done;
+        if (res == FR_OK && done != len) {
+            res = FR_DENIED; // Volume full
+        }
+    }
+    return res;
+}
+
+// Write len bytes at offset, creating the file if needed
+extern "C" FRESULT fatfs_write(const char* path, vic_uint32 offset, const void* buf, vic_uint32 len,
+                               vic_uint32* count) {
+    FIL file;
+    FRESULT res = f_open(&file, path, FA_WRITE | FA_OPEN_ALWAYS);
+    if (res != FR_OK) {
+        *count = 0;
+        return res;
+    }
+
+    res = fatfs_write_at(&file, offset, buf, len, count);
+    FRESULT close_res = f_close(&file);
+    return (res != FR_OK) ? res : close_res;
+}
+
+// Append len bytes, creating the file if needed
+// Only the new data is written; FatFs seeks straight to the end
+extern "C" FRESULT fatfs_append(const char* path, const void* buf, vic_uint32 len, vic_uint32* count) {
+    FIL file;
+    FRESULT res = f_open(&file, path, FA_WRITE | FA_OPEN_APPEND);
+    if (res != FR_OK) {
+        *count = 0;
+        return res;
+    }
+
+    res = fatfs_write_at(&file, (vic_uint32)f_size(&file), buf, len, count);
+    FRESULT close_res = f_close(&file);
+    return (res != FR_OK) ? res : close_res;
+}
+
+// VFS backend: FatFs volume 0, usually mounted at "/disk"
+
+// Build a FatFs path ("0:/etc/motd") from a mount-relative one
+static void fatfs_make_path(const char* rel, TCHAR* out) {
+    out[0] = '0';
+    out[1] = ':';
+    int i = 0;
+    while (rel[i]) {
+        out[i + 2] = rel[i];
+        i++;
+    }
+    out[i + 2] = '\0';
+}
+
+// Translate a FatFs result into a VFS error
+static int fatfs_to_vfs_error(FRESULT res) {
+    switch (res) {
+        case FR_OK:             return VFS_OK;
+        case FR_NO_FILE:
+        case FR_NO_PATH:        return VFS_ERR_NOT_FOUND;
+        case FR_EXIST:          return VFS_ERR_EXISTS;
+        case FR_INVALID_NAME:   return VFS_ERR_INVALID;
+        case FR_DENIED:         return VFS_ERR_NO_SPACE;
+        case FR_LOCKED:         return VFS_ERR_BUSY;
+        case FR_TOO_MANY_OPEN_FILES: return VFS_ERR_TOO_MANY;
+        default:                return VFS_ERR_IO;
+    }
+}
+
+// FIL behind a vnode, opened on first use and kept until release
+// Files open read-only, since FatFs refuses write access to AM_RDO entries,
+// and are reopened writable on the first write or truncate
+static FIL* fatfs_node_file(VNode* node, bool write) {
+    FIL* file = (FIL*)node->priv;
+    if (file && (!write || (file->flag & FA_WRITE))) {
+        return file;
+    }
+
+    if (file) {
+        // Nothing to flush on a read-only handle
+        f_close(file);
+        node->priv = nullptr;
+    } else {
+        if (!fatfs_file_cache) {
+            fatfs_file_cache = kmem_cache_create("fatfs-FIL", sizeof(FIL));
+        }
+        file = (FIL*)kmem_cache_alloc(fatfs_file_cache);
+        if (!file) {
+            return nullptr;
+        }
+    }
+
+    TCHAR path[VFS_MAX_PATH + 2];
+    fatfs_make_path(node->path, path);
+    BYTE mode = write ? (FA_READ | FA_WRITE) : FA_READ;
+    if (f_open(file, path, mode | FA_OPEN_EXISTING) != FR_OK) {
+        kmem_cache_free(fatfs_file_cache, file);
+        return nullptr;
+    }
+    node->priv = file;
+    return file;
+}
+
+static int fatfs_vfs_mount(VfsMount* mnt) {
+    if (disk_initialize() <= 0) {
+        return VFS_ERR_IO;
+    }
+
+    FRESULT res = f_mount(&fatfs_volume, "0:", 1);
+    if (res != FR_OK) {
+        return fatfs_to_vfs_error(res);
+    }
+
+    mnt->priv = &fatfs_volume;
+    return VFS_OK;
+}
+
+static int fatfs_vfs_unmount(VfsMount* mnt) {
+    f_mount(nullptr, "0:", 0);
+    mnt->priv = nullptr;
+    return VFS_OK;
+}
+
+static int fatfs_vfs_lookup(VfsMount* /* mnt */, const char* path, VNode* node) {
+    // The volume root has no directory entry of its own
+    if (path[1] == '\0') {
+        node->type = VFS_TYPE_DIRECTORY;
+        node->size = 0;
+        return VFS_OK;
+    }
+
+    TCHAR fpath[VFS_MAX_PATH + 2];
+    FILINFO info;
+    fatfs_make_path(path, fpath);
+
+    FRESULT res = f_stat(fpath, &info);
+    if (res != FR_OK) {
+        return fatfs_to_vfs_error(res);
+    }
+
+    node->type = (info.fattrib & AM_DIR) ? VFS_TYPE_DIRECTORY : VFS_TYPE_FILE;
+    // VFS offsets are 32-bit; larger exFAT files show their first 4 GiB
+    node->size = (info.fsize > 0xFFFFFFFF) ? 0xFFFFFFFF : (vic_uint32)info.fsize;
+    return VFS_OK;
+}
+
+static int fatfs_vfs_create(VfsMount* /* mnt */, const char* path, VNode* node) {
+    TCHAR fpath[VFS_MAX_PATH + 2];
+    FIL file;
+    fatfs_make_path(path, fpath);
+
+    FRESULT res = f_open(&file, fpath, FA_WRITE | FA_CREATE_NEW);
+    if (res != FR_OK) {
+        return fatfs_to_vfs_error(res);
+    }
+    f_close(&file);
+
+    node->type = VFS_TYPE_FILE;
+    node->size = 0;
+    return VFS_OK;
+}
+
+static int fatfs_vfs_mkdir(VfsMount* /* mnt */, const char* path) {
+    TCHAR fpath[VFS_MAX_PATH + 2];
+    fatfs_make_path(path, fpath);
+    return fatfs_to_vfs_error(f_mkdir(fpath));
+}
+
+static int fatfs_vfs_remove(VfsMount* /* mnt */, const char* path) {
+    TCHAR fpath[VFS_MAX_PATH + 2];
+    fatfs_make_path(path, fpath);
+
+    // f_unlink refuses non-empty directories (and read-only entries)
+    FRESULT res = f_unlink(fpath);
+    return (res == FR_DENIED) ? VFS_ERR_NOT_EMPTY : fatfs_to_vfs_error(res);
+}
+
+static int fatfs_vfs_read(VNode* node, vic_uint32 offset, void* buf, vic_uint32 len) {
+    FIL* file = fatfs_node_file(node, false);
+    if (!file) {
+        return VFS_ERR_IO;
+    }
+
+    UINT count;
+    FRESULT res = f_lseek(file, offset);
+    if (res == FR_OK) {
+        res = f_read(file, buf, len, &count);
+    }
+    return (res == FR_OK) ? (int)count : fatfs_to_vfs_error(res);
+}
+
+static int fatfs_vfs_write(VNode* node, vic_uint32 offset, const void* buf, vic_uint32 len) {
+    FIL* file = fatfs_node_file(node, true);
+    if (!file) {
+        return VFS_ERR_IO;
+    }
+
+    UINT count;
+    FRESULT res = fatfs_zero_extend(file, offset);
+    if (res == FR_OK) {
+        res = f_lseek(file, offset);
+    }
+    if (res == FR_OK) {
+        res = f_write(file, buf, len, &count);
+    }
+    return (res == FR_OK) ? (int)count : fatfs_to_vfs_error(res);
+}
+
+static int fatfs_vfs_truncate(VNode* node, vic_uint32 size) {
+    FIL* file = fatfs_node_file(node, true);
+    if (!file) {
+        return VFS_ERR_IO;
+    }
+
+    FRESULT res = fatfs_zero_extend(file, size);
+    if (res == FR_OK) {
+        res = f_lseek(file, size);
+    }
+    if (res == FR_OK) {
+        res = f_truncate(file);
+    }
+    return fatfs_to_vfs_error(res);
+}
+
+static int fatfs_vfs_opendir(VNode* node, VfsFile* dir) {
+    if (!fatfs_dir_cache) {
+        fatfs_dir_cache = kmem_cache_create("fatfs-DIR", sizeof(DIR));
+    }
+    DIR* fdir = (DIR*)kmem_cache_alloc(fatfs_dir_cache);
+    if (!fdir) {
+        return VFS_ERR_TOO_MANY;
+    }
+
+    TCHAR fpath[VFS_MAX_PATH + 2];
+    fatfs_make_path(node->path, fpath);
+
+    FRESULT res = f_opendir(fdir, fpath);
+    if (res != FR_OK) {
+        kmem_cache_free(fatfs_dir_cache, fdir);
+        return fatfs_to_vfs_error(res);
+    }
+    dir->priv = fdir;
+    return VFS_OK;
+}
+
+static int fatfs_vfs_readdir(VNode* /* node */, VfsFile* dir, VfsDirEntry* entry) {
+    FILINFO info;
+    FRESULT res = f_readdir((DIR*)dir->priv, &info);
+    if (res != FR_OK) {
+        return fatfs_to_vfs_error(res);
+    }
+    if (info.fname[0] == '\0') {
+        return 0; // End of directory
+    }
+
+    int i = 0;
+    while (info.fname[i] && i < VFS_MAX_NAME - 1) {
+        entry->name[i] = info.fname[i];
+        i++;
+    }
+    entry->name[i] = '\0';
+    entry->type = (info.fattrib & AM_DIR) ? VFS_TYPE_DIRECTORY : VFS_TYPE_FILE;
+    entry->size = (info.fsize > 0xFFFFFFFF) ? 0xFFFFFFFF : (vic_uint32)info.fsize;
+    return 1;
+}
+
+static void fatfs_vfs_closedir(VNode* /* node */, VfsFile* dir) {
+    DIR* fdir = (DIR*)dir->priv;
+    f_closedir(fdir);
+    kmem_cache_free(fatfs_dir_cache, fdir);
+    dir->priv = nullptr;
+}
+
+// Close the FIL on last close or eviction, flushing its sector buffer
+static void fatfs_vfs_release(VNode* node) {
+    FIL* file = (FIL*)node->priv;
+    if (!file) {
+        return;
+    }
+
+    f_close(file);
+    kmem_cache_free(fatfs_file_cache, file);
+    node->priv = nullptr;
+}
+
+// f_forward sink that hands data on to the VFS sink
+static UINT fatfs_forward_sink(const BYTE* data, UINT count) {
+    // A zero-length call is a readiness check; VFS sinks never block
+    if (count == 0) {
+        return 1;
+    }
+
+    fatfs_active_sink((const char*)data, count);
+    return count;
+}
+
+// Stream straight out of the FatFs sector window, no bounce buffer
+static int fatfs_vfs_stream(VNode* node, vic_uint32 offset, VfsSink sink) {
+    FIL* file = fatfs_node_file(node, false);
+    if (!file) {
+        return VFS_ERR_IO;
+    }
+
+    FRESULT res = f_lseek(file, offset);
+    if (res != FR_OK) {
+        return fatfs_to_vfs_error(res);
+    }
+
+    fatfs_active_sink = sink;
+    vic_uint32 total = 0;
+    UINT forwarded;
+
+    // Forward the file one chunk at a time until EOF
+    while (f_tell(file) < f_size(file)) {
+        res = f_forward(file, fatfs_forward_sink, FATFS_STREAM_CHUNK, &forwarded);
+        if (res != FR_OK || forwarded == 0) {
+            break;
+        }
+        total += forwarded;
+    }
+
+    fatfs_active_sink = nullptr;
+    return (res == FR_OK) ? (int)total : fatfs_to_vfs_error(res);
+}
+
+// Flush FatFs's sector buffer and directory entry for an open file
+static int fatfs_vfs_sync(VNode* node) {
+    FIL* file = (FIL*)node->priv;
+    if (!file) {
+        return VFS_OK;
+    }
+    return fatfs_to_vfs_error(f_sync(file));
+}
+
+const VfsOps fatfs_vfs_ops = {
+    "fatfs",
+    fatfs_vfs_mount,
+    fatfs_vfs_unmount,
+    fatfs_vfs_lookup,
+    fatfs_vfs_create,
+    fatfs_vfs_mkdir,
+    fatfs_vfs_remove,
+    fatfs_vfs_read,
+    fatfs_vfs_write,
+    fatfs_vfs_truncate,
+    fatfs_vfs_opendir,
+    fatfs_vfs_readdir,
+    fatfs_vfs_closedir,
+    fatfs_vfs_release,
+    fatfs_vfs_stream,
+    fatfs_vfs_sync,
+    nullptr
+};
@@ -23,14 +23,14 @@ typedef enum {
 } FRESULT;
 
 // Function declarations
-void fatfs_init(void);
+int fatfs_format(int use_exfat);
 FRESULT fatfs_mkdir(const char* path);
 FRESULT fatfs_write_file(const char* path, const char* content, vic_size_t len);
-FRESULT fatfs_read_file(const char* path, char* buffer, vic_size_t buffer_size, vic_size_t* bytes_read);
-FRESULT fatfs_ls(const char* path);
-FRESULT fatfs_cd(const char* path);
-FRESULT fatfs_pwd(char* buffer, vic_size_t size);
-void process_fatfs_install(const char* args);
+
+// Binary-safe data access; count receives the bytes transferred
+FRESULT fatfs_read(const char* path, vic_uint32 offset, void* buf, vic_uint32 len, vic_uint32* count);
+FRESULT fatfs_write(const char* path, vic_uint32 offset, const void* buf, vic_uint32 len, vic_uint32* count);
+FRESULT fatfs_append(const char* path, const void* buf, vic_uint32 len, vic_uint32* count);
 
 #ifdef __cplusplus
 }
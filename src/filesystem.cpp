@@ -1,31 +1,49 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "vfs.h"
+#include "pmm.h"
+#include "kheap.h"
 
 // Forward declarations
 void kprint(const char* str);
 
+// Forward declarations from fs_log.cpp (write-ahead log)
+void fs_log_create(const char* path, vic_uint8 type);
+void fs_log_write(const char* path, vic_uint32 offset, const void* buf, vic_uint32 len);
+void fs_log_truncate(const char* path, vic_uint32 size);
+void fs_log_remove(const char* path);
+void fs_log_clone(const char* src, const char* dst);
+
 // Maximum filename length
 #define FS_MAX_FILENAME 32
 
 // Maximum path length
 #define FS_MAX_PATH 256
 
-// Maximum number of files in the filesystem
-#define FS_MAX_FILES 64
+// File data lives in a pool of fixed-size blocks taken from the page
+// allocator on first use: 1/FS_POOL_SHARE of memory, from 2^FS_POOL_MIN_ORDER
+// pages up to one largest buddy block
+#define FS_BLOCK_SIZE 1024
+#define FS_POOL_SHARE 8
+#define FS_POOL_MIN_ORDER 6
 
-// Maximum number of directories in the filesystem
-#define FS_MAX_DIRS 32
+// Contiguous block runs a file can own
+#define FS_MAX_EXTENTS 8
 
-// Maximum file size
-#define FS_MAX_FILE_SIZE 4096
+// Node slots: one per FS_BLOCKS_PER_NODE pool blocks, at least FS_MIN_NODES
+#define FS_BLOCKS_PER_NODE 16
+#define FS_MIN_NODES 96
 
 // File types
 #define FS_TYPE_FILE 1
 #define FS_TYPE_DIRECTORY 2
 
-// Current working directory path
-char current_path[FS_MAX_PATH] = "/";
+// Run of pool blocks holding part of a file
+struct FSExtent {
+    vic_uint32 start;      // First block
+    vic_uint32 count;      // Number of blocks
+};
 
 // File/directory structure
 struct FSNode {
@@ -34,21 +52,70 @@ struct FSNode {
     vic_uint32 size;
     vic_uint32 parent_index; // Index of parent directory
     bool used;             // Whether this entry is in use
+    vic_uint8 name_len;    // Cached fs_strlen(name)
+    vic_uint8 depth;       // Levels below the root (root is 0)
 
-    // For files, this holds the content
-    // For directories, this is unused
-    char content[FS_MAX_FILE_SIZE];
-};
+    // Directory children, kept sorted by name (-1 ends the list)
+    vic_int32 first_child;
+    vic_int32 next_sibling;
 
-// Root directory (index 0 is always root)
-FSNode filesystem[FS_MAX_FILES + FS_MAX_DIRS];
+    // File data, in file order. Directories and empty files own none.
+    vic_uint32 extent_count;
+    FSExtent extents[FS_MAX_EXTENTS];
+};
 
-// Current directory index
-vic_uint32 current_dir = 0;
+// Result of fs_resolve
+struct FSResolve {
+    vic_int32 parent;      // Directory holding the leaf
+    vic_int32 node;        // Leaf node, -1 if missing (FS_RESOLVE_CREATE)
+    const char* name;      // Leaf name, not null-terminated
+    vic_size_t name_len;
+};
 
-// Forward declarations of functions to resolve circular dependencies
-vic_uint32 fs_mkdir(const char* path);
-vic_uint32 fs_touch(const char* path, const char* content);
+// fs_resolve flags
+#define FS_RESOLVE_CREATE 0x01 // A missing leaf is fine if its parent exists
+
+// Node table (index 0 is always root) and its size; set up by fs_setup
+FSNode* filesystem = nullptr;
+vic_uint32 fs_max_nodes = 0;
+
+// Node slot allocation bitmap (bit set = slot in use) and the word to
+// search first
+vic_uint32* fs_node_map;
+vic_uint32 fs_node_hint = 0;
+
+// Data block pool and its allocation bitmap (bit set = block in use)
+char* fs_pool;
+vic_uint32 fs_pool_blocks = 0;
+vic_uint32* fs_block_map;
+
+// References to each block. Deduplication and cp let files share
+// blocks; a shared block is copied before it is modified. A block at
+// FS_MAX_REFS takes no more sharers: they get a copy instead.
+#define FS_MAX_REFS 0xFFFF
+vic_uint16* fs_block_refs;
+
+// Content index for block deduplication. Each indexed block sits on the
+// chain of its hash bucket (-1 ends a chain); a block leaves its chain
+// when it is freed or about to be rewritten, so every chained block still
+// holds the bytes it was hashed from.
+#define FS_DEDUP_BUCKETS 512
+
+vic_uint32* fs_dedup_map;          // Bit set = block is indexed
+vic_uint32* fs_dedup_hash;
+vic_int16* fs_dedup_prev;
+vic_int16* fs_dedup_next;
+vic_int16 fs_dedup_heads[FS_DEDUP_BUCKETS];
+
+// Open-addressing hash index of (parent_index, name) -> node index
+// Empty slots hold -1; the root is not indexed. The size is a power of
+// two at least twice fs_max_nodes so probe sequences stay short.
+struct FSIndexSlot {
+    vic_int32 node;
+    vic_uint32 hash;
+};
+FSIndexSlot* fs_index;
+vic_uint32 fs_index_size = 0;
 
 // String operations
 bool fs_strcmp(const char* s1, const char* s2) {
@@ -74,540 +141,1610 @@ vic_size_t fs_strlen(const char* str) {
     return len;
 }
 
-void fs_strcat(char* dest, const char* src) {
-    while (*dest) {
-        dest++;
+// FNV-1a over the parent index and the name bytes
+static vic_uint32 fs_hash(vic_uint32 parent, const char* name, vic_size_t len) {
+    vic_uint32 hash = 2166136261u;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((parent >> (i * 8)) & 0xFF)) * 16777619u;
     }
-    while (*src) {
-        *dest++ = *src++;
+    for (vic_size_t i = 0; i < len; i++) {
+        hash = (hash ^ (vic_uint8)name[i]) * 16777619u;
     }
-    *dest = '\0';
+    return hash;
 }
 
-// Find a node by path
-// Returns the index of the node, or -1 if not found
-int fs_find_node(const char* path) {
-    // Handle empty path
-    if (!path || !*path) {
-        return -1;
+// Compare a node name with a name that is not null-terminated
+static bool fs_name_equals(const char* node_name, const char* name, vic_size_t len) {
+    for (vic_size_t i = 0; i < len; i++) {
+        if (node_name[i] != name[i]) {
+            return false;
+        }
     }
+    return node_name[len] == '\0';
+}
 
-    // Handle absolute vs relative path
-    vic_uint32 start_dir;
-    const char* path_ptr = path;
+// Find the child called name (len bytes) of parent
+// Returns the node index, or -1 if there is none
+int fs_index_lookup(vic_uint32 parent, const char* name, vic_size_t len) {
+    vic_uint32 hash = fs_hash(parent, name, len);
 
-    if (path[0] == '/') {
-        // Absolute path, start from root
-        start_dir = 0;
-        path_ptr++; // Skip the leading /
-    } else {
-        // Relative path, start from current directory
-        start_dir = current_dir;
+    for (vic_uint32 i = 0; i < fs_index_size; i++) {
+        FSIndexSlot* slot = &fs_index[(hash + i) & (fs_index_size - 1)];
+        if (slot->node == -1) {
+            return -1;
+        }
+        if (slot->hash == hash &&
+            filesystem[slot->node].parent_index == parent &&
+            fs_name_equals(filesystem[slot->node].name, name, len)) {
+            return slot->node;
+        }
     }
+    return -1;
+}
+
+// Add a node to the index
+void fs_index_insert(vic_uint32 index) {
+    vic_uint32 hash = fs_hash(filesystem[index].parent_index, filesystem[index].name,
+                              filesystem[index].name_len);
 
-    // Handle empty path after processing (root directory)
-    if (!*path_ptr) {
-        return 0; // Root directory
+    // The table is larger than the node table, so a free slot always exists
+    vic_uint32 pos = hash & (fs_index_size - 1);
+    while (fs_index[pos].node != -1) {
+        pos = (pos + 1) & (fs_index_size - 1);
     }
+    fs_index[pos].node = index;
+    fs_index[pos].hash = hash;
+}
 
-    // Handle "." (current directory)
-    if (fs_strcmp(path_ptr, ".")) {
-        return current_dir;
+// Remove a node from the index
+// Later entries of the probe run shift back, so no tombstones build up
+void fs_index_remove(vic_uint32 index) {
+    vic_uint32 hash = fs_hash(filesystem[index].parent_index, filesystem[index].name,
+                              filesystem[index].name_len);
+
+    // Find the node's slot
+    vic_uint32 pos = hash & (fs_index_size - 1);
+    while (fs_index[pos].node != (vic_int32)index) {
+        if (fs_index[pos].node == -1) {
+            return; // Not indexed
+        }
+        pos = (pos + 1) & (fs_index_size - 1);
+    }
+
+    fs_index[pos].node = -1;
+    vic_uint32 next = (pos + 1) & (fs_index_size - 1);
+    while (fs_index[next].node != -1) {
+        vic_uint32 home = fs_index[next].hash & (fs_index_size - 1);
+
+        // Move the entry into the hole unless its home lies after the hole
+        // (cyclically) and at or before its current slot
+        bool stays = (next > pos) ? (home > pos && home <= next)
+                                  : (home > pos || home <= next);
+        if (!stays) {
+            fs_index[pos] = fs_index[next];
+            fs_index[next].node = -1;
+            pos = next;
+        }
+        next = (next + 1) & (fs_index_size - 1);
     }
+}
 
-    // Handle ".." (parent directory)
-    if (fs_strcmp(path_ptr, "..")) {
-        return filesystem[current_dir].parent_index;
+// Resolve a path in one walk
+// Paths are resolved from the root; the VFS hands us canonical paths and
+// owns the working directory. On success out->node is the leaf, and
+// out->parent/name/name_len describe where it lives (name points into
+// path). With FS_RESOLVE_CREATE a missing leaf is not an error: node is
+// -1 and parent/name say where to create it.
+// Returns VFS_OK, or a negative VFS error code
+int fs_resolve(const char* path, int flags, FSResolve* out) {
+    // Handle empty path
+    if (!path || !*path) {
+        return VFS_ERR_INVALID;
     }
 
-    // Parse path components
-    char component[FS_MAX_FILENAME];
-    vic_uint32 current_index = start_dir;
+    // The root is its own parent
+    out->parent = 0;
+    out->node = 0;
+    out->name = filesystem[0].name;
+    out->name_len = 1;
 
-    while (*path_ptr) {
-        // Extract next component
-        int i = 0;
-        while (*path_ptr && *path_ptr != '/' && i < FS_MAX_FILENAME - 1) {
-            component[i++] = *path_ptr++;
-        }
-        component[i] = '\0';
+    const char* path_ptr = path;
+    vic_uint32 current_index = 0;
 
-        // Skip any trailing slash
-        if (*path_ptr == '/') {
+    while (*path_ptr) {
+        // Skip separators (also handles // in paths)
+        while (*path_ptr == '/') {
             path_ptr++;
         }
-
-        // Handle empty component (// in path)
-        if (component[0] == '\0') {
-            continue;
+        if (!*path_ptr) {
+            break;
         }
 
-        // Handle "." (current directory)
-        if (fs_strcmp(component, ".")) {
-            continue;
+        // Find the end of the next component
+        const char* component = path_ptr;
+        while (*path_ptr && *path_ptr != '/') {
+            path_ptr++;
         }
+        vic_size_t len = path_ptr - component;
 
-        // Handle ".." (parent directory)
-        if (fs_strcmp(component, "..")) {
-            current_index = filesystem[current_index].parent_index;
-            continue;
+        // Only slashes may follow the leaf
+        const char* rest = path_ptr;
+        while (*rest == '/') {
+            rest++;
         }
+        bool leaf = (*rest == '\0');
 
-        // Search for the component in the current directory
-        bool found = false;
-        for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-            if (filesystem[i].used &&
-                filesystem[i].parent_index == current_index &&
-                fs_strcmp(filesystem[i].name, component)) {
+        if (filesystem[current_index].type != FS_TYPE_DIRECTORY) {
+            return VFS_ERR_NOT_DIR;
+        }
 
-                current_index = i;
-            found = true;
-            break;
+        vic_int32 next;
+        if (len == 1 && component[0] == '.') {
+            next = current_index;
+        } else if (len == 2 && component[0] == '.' && component[1] == '.') {
+            next = filesystem[current_index].parent_index;
+        } else {
+            next = fs_index_lookup(current_index, component, len);
+            if (next == -1) {
+                if (!leaf || !(flags & FS_RESOLVE_CREATE)) {
+                    return VFS_ERR_NOT_FOUND;
                 }
-        }
 
-        if (!found) {
-            return -1; // Component not found
+                // Missing leaf: report where it would go
+                out->parent = current_index;
+                out->node = -1;
+                out->name = component;
+                out->name_len = len;
+                return VFS_OK;
+            }
         }
+
+        current_index = next;
     }
 
-    return current_index;
+    out->node = current_index;
+    out->parent = filesystem[current_index].parent_index;
+    out->name = filesystem[current_index].name;
+    out->name_len = filesystem[current_index].name_len;
+    return VFS_OK;
+}
+
+// Find a node by path
+// Returns the index of the node, or -1 if not found
+int fs_find_node(const char* path) {
+    FSResolve res;
+    if (fs_resolve(path, 0, &res) < 0) {
+        return -1;
+    }
+    return res.node;
 }
 
 // Get the full path of a node
-void fs_get_path(vic_uint32 node_index, char* path_buffer) {
+// The length is known up front from the cached name lengths and depth,
+// so the path is written right to left straight into path_buffer
+// Returns the path length, or VFS_ERR_INVALID if it exceeds FS_MAX_PATH
+int fs_get_path(vic_uint32 node_index, char* path_buffer) {
     if (node_index == 0) {
         // Root directory
         path_buffer[0] = '/';
         path_buffer[1] = '\0';
-        return;
+        return 1;
+    }
+
+    // One separator per level plus the names
+    vic_size_t len = filesystem[node_index].depth;
+    for (vic_uint32 current = node_index; current != 0; current = filesystem[current].parent_index) {
+        len += filesystem[current].name_len;
+    }
+    if (len >= FS_MAX_PATH) {
+        return VFS_ERR_INVALID;
     }
 
-    // Build path by traversing up to root
-    path_buffer[0] = '\0';
-    char temp[FS_MAX_PATH];
-    vic_uint32 current = node_index;
+    path_buffer[len] = '\0';
+    vic_size_t pos = len;
+    for (vic_uint32 current = node_index; current != 0; current = filesystem[current].parent_index) {
+        pos -= filesystem[current].name_len;
+        for (vic_size_t i = 0; i < filesystem[current].name_len; i++) {
+            path_buffer[pos + i] = filesystem[current].name[i];
+        }
+        path_buffer[--pos] = '/';
+    }
 
-    while (current != 0) {
-        // Add current node name
-        fs_strcpy(temp, path_buffer);
-        path_buffer[0] = '/';
-        fs_strcpy(path_buffer + 1, filesystem[current].name);
-        fs_strcat(path_buffer, temp);
+    return len;
+}
 
-        // Move up to parent
-        current = filesystem[current].parent_index;
+// Take a block off its dedup chain
+static void fs_dedup_forget(vic_uint32 block) {
+    if (!(fs_dedup_map[block / 32] & (1u << (block % 32)))) {
+        return;
     }
+    fs_dedup_map[block / 32] &= ~(1u << (block % 32));
 
-    // If path is empty, it's root
-    if (path_buffer[0] == '\0') {
-        path_buffer[0] = '/';
-        path_buffer[1] = '\0';
+    vic_int16 prev = fs_dedup_prev[block];
+    vic_int16 next = fs_dedup_next[block];
+    if (prev != -1) {
+        fs_dedup_next[prev] = next;
+    } else {
+        fs_dedup_heads[fs_dedup_hash[block] & (FS_DEDUP_BUCKETS - 1)] = next;
+    }
+    if (next != -1) {
+        fs_dedup_prev[next] = prev;
     }
 }
 
-// Initialize the filesystem
-void fs_init() {
-    // Initialize all entries as unused
-    for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-        filesystem[i].used = false;
+// Put a block on the chain for its hash
+static void fs_dedup_insert(vic_uint32 block, vic_uint32 hash) {
+    vic_int16* head = &fs_dedup_heads[hash & (FS_DEDUP_BUCKETS - 1)];
+    fs_dedup_hash[block] = hash;
+    fs_dedup_prev[block] = -1;
+    fs_dedup_next[block] = *head;
+    if (*head != -1) {
+        fs_dedup_prev[*head] = block;
     }
+    *head = block;
+    fs_dedup_map[block / 32] |= 1u << (block % 32);
+}
 
-    // Set up the root directory
-    fs_strcpy(filesystem[0].name, "/");
-    filesystem[0].type = FS_TYPE_DIRECTORY;
-    filesystem[0].size = 0;
-    filesystem[0].parent_index = 0; // Root is its own parent
-    filesystem[0].used = true;
-
-    // Create a few default directories
-    fs_mkdir("/bin");
-    fs_mkdir("/home");
-    fs_mkdir("/etc");
+// Take a reference to a run of blocks, allocating any that were free
+static void fs_block_get(vic_uint32 start, vic_uint32 count) {
+    for (vic_uint32 b = start; b < start + count; b++) {
+        if (fs_block_refs[b]++ == 0) {
+            fs_block_map[b / 32] |= 1u << (b % 32);
+        }
+    }
+}
 
-    // Create some default files
-    fs_touch("/etc/motd", "Welcome to VicOS Filesystem!\n");
-    fs_touch("/home/readme.txt", "This is your home directory.\n");
+// Drop a reference to a run of blocks, freeing those nobody else holds
+static void fs_block_put(vic_uint32 start, vic_uint32 count) {
+    for (vic_uint32 b = start; b < start + count; b++) {
+        if (--fs_block_refs[b] == 0) {
+            fs_block_map[b / 32] &= ~(1u << (b % 32));
+            fs_dedup_forget(b);
+        }
+    }
+}
 
-    kprint("Filesystem initialized.\n");
+static bool fs_block_used(vic_uint32 block) {
+    return fs_block_map[block / 32] & (1u << (block % 32));
 }
 
-// Change directory
-bool fs_cd(const char* path) {
-    int node_index = fs_find_node(path);
+// Find free blocks for an allocation of max blocks: the first free run
+// that is long enough, else the longest one, so files stay in few extents
+// Returns the run length (0 if the pool is full) and its start in *start
+static vic_uint32 fs_find_free_run(vic_uint32 max, vic_uint32* start) {
+    vic_uint32 best_start = 0;
+    vic_uint32 best_count = 0;
+    vic_uint32 block = 0;
+
+    while (block < fs_pool_blocks) {
+        // Skip full words
+        if (block % 32 == 0 && fs_block_map[block / 32] == 0xFFFFFFFF) {
+            block += 32;
+            continue;
+        }
+        if (fs_block_used(block)) {
+            block++;
+            continue;
+        }
 
-    if (node_index == -1) {
-        kprint("Error: Directory not found: ");
-        kprint(path);
-        kprint("\n");
-        return false;
+        vic_uint32 run_start = block;
+        while (block < fs_pool_blocks && !fs_block_used(block) && block - run_start < max) {
+            block++;
+        }
+
+        vic_uint32 count = block - run_start;
+        if (count == max) {
+            *start = run_start;
+            return count;
+        }
+        if (count > best_count) {
+            best_start = run_start;
+            best_count = count;
+        }
     }
 
-    if (filesystem[node_index].type != FS_TYPE_DIRECTORY) {
-        kprint("Error: Not a directory: ");
-        kprint(path);
-        kprint("\n");
-        return false;
+    *start = best_start;
+    return best_count;
+}
+
+// Blocks currently owned by a node
+static vic_uint32 fs_node_blocks(FSNode* node) {
+    vic_uint32 blocks = 0;
+    for (vic_uint32 i = 0; i < node->extent_count; i++) {
+        blocks += node->extents[i].count;
     }
+    return blocks;
+}
 
-    // Update current directory
-    current_dir = node_index;
+// Release blocks from the end of a file until it owns at most keep blocks
+static void fs_shrink_blocks(FSNode* node, vic_uint32 keep) {
+    vic_uint32 blocks = fs_node_blocks(node);
 
-    // Update current path
-    fs_get_path(current_dir, current_path);
+    while (blocks > keep) {
+        FSExtent* last = &node->extents[node->extent_count - 1];
+        vic_uint32 drop = blocks - keep;
+        if (drop > last->count) {
+            drop = last->count;
+        }
 
-    return true;
+        fs_block_put(last->start + last->count - drop, drop);
+        last->count -= drop;
+        blocks -= drop;
+        if (last->count == 0) {
+            node->extent_count--;
+        }
+    }
 }
 
-// List directory contents
-void fs_ls(const char* path) {
-    // If path is empty or null, use current directory
-    if (!path || !*path) {
-        path = ".";
+// Make sure a file owns enough blocks for size bytes
+// Grows the last extent in place when the following blocks are free,
+// otherwise appends first-fit runs. Nothing changes on failure.
+static int fs_reserve(FSNode* node, vic_uint32 size) {
+    vic_uint32 have = fs_node_blocks(node);
+    vic_uint32 need = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (need <= have) {
+        return VFS_OK;
     }
 
-    int dir_index = fs_find_node(path);
+    vic_uint32 missing = need - have;
 
-    if (dir_index == -1) {
-        kprint("Error: Directory not found: ");
-        kprint(path);
-        kprint("\n");
-        return;
+    // Extend the last run in place
+    if (node->extent_count > 0) {
+        FSExtent* last = &node->extents[node->extent_count - 1];
+        while (missing > 0 && last->start + last->count < fs_pool_blocks &&
+               !fs_block_used(last->start + last->count)) {
+            fs_block_get(last->start + last->count, 1);
+            last->count++;
+            missing--;
+        }
     }
 
-    if (filesystem[dir_index].type != FS_TYPE_DIRECTORY) {
-        kprint("Error: Not a directory: ");
-        kprint(path);
-        kprint("\n");
-        return;
+    // Add new runs
+    while (missing > 0) {
+        vic_uint32 start;
+        vic_uint32 count = fs_find_free_run(missing, &start);
+        if (count == 0 || node->extent_count == FS_MAX_EXTENTS) {
+            fs_shrink_blocks(node, have);
+            return VFS_ERR_NO_SPACE;
+        }
+
+        fs_block_get(start, count);
+        node->extents[node->extent_count].start = start;
+        node->extents[node->extent_count].count = count;
+        node->extent_count++;
+        missing -= count;
     }
 
-    // Print directory contents
-    kprint("Contents of ");
-    char path_buffer[FS_MAX_PATH];
-    fs_get_path(dir_index, path_buffer);
-    kprint(path_buffer);
-    kprint(":\n");
+    return VFS_OK;
+}
 
-    bool found = false;
+// Map a file offset to its bytes in the pool
+// Sets run to the number of bytes contiguous from there
+static char* fs_data_ptr(FSNode* node, vic_uint32 offset, vic_uint32* run) {
+    vic_uint32 base = 0;
+    for (vic_uint32 i = 0; i < node->extent_count; i++) {
+        vic_uint32 bytes = node->extents[i].count * FS_BLOCK_SIZE;
+        if (offset < base + bytes) {
+            *run = base + bytes - offset;
+            return &fs_pool[node->extents[i].start * FS_BLOCK_SIZE + (offset - base)];
+        }
+        base += bytes;
+    }
+    *run = 0;
+    return nullptr;
+}
 
-    // First, list directories
-    for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-        if (filesystem[i].used &&
-            filesystem[i].parent_index == (vic_uint32)dir_index &&
-            filesystem[i].type == FS_TYPE_DIRECTORY) {
+// Copy between a file and a buffer; the range must already be allocated
+static void fs_data_copy(FSNode* node, vic_uint32 offset, char* buf, vic_uint32 len, bool to_file) {
+    while (len > 0) {
+        vic_uint32 run;
+        char* data = fs_data_ptr(node, offset, &run);
+        if (run > len) {
+            run = len;
+        }
 
-            found = true;
-        kprint("[DIR] ");
-        kprint(filesystem[i].name);
-        kprint("\n");
+        for (vic_uint32 i = 0; i < run; i++) {
+            if (to_file) {
+                data[i] = buf[i];
+            } else {
+                buf[i] = data[i];
             }
+        }
+        offset += run;
+        buf += run;
+        len -= run;
     }
+}
 
-    // Then, list files
-    for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-        if (filesystem[i].used &&
-            filesystem[i].parent_index == (vic_uint32)dir_index &&
-            filesystem[i].type == FS_TYPE_FILE) {
+// Fill a file range with zeros; the range must already be allocated
+static void fs_data_zero(FSNode* node, vic_uint32 offset, vic_uint32 len) {
+    while (len > 0) {
+        vic_uint32 run;
+        char* data = fs_data_ptr(node, offset, &run);
+        if (run > len) {
+            run = len;
+        }
+        for (vic_uint32 i = 0; i < run; i++) {
+            data[i] = '\0';
+        }
+        offset += run;
+        len -= run;
+    }
+}
 
-            found = true;
-        kprint("[FILE] ");
-        kprint(filesystem[i].name);
-        kprint(" (");
+// Copy blocks into a fresh run and drop the reference to the originals
+// Returns the new run's first block, or -1 if no run is free
+static int fs_copy_blocks(vic_uint32 start, vic_uint32 count) {
+    vic_uint32 fresh;
+    if (fs_find_free_run(count, &fresh) != count) {
+        return -1;
+    }
+    fs_block_get(fresh, count);
 
-        // Convert size to string (simple implementation)
-        char size_str[16];
-        vic_uint32 size = filesystem[i].size;
-        if (size == 0) {
-            size_str[0] = '0';
-            size_str[1] = '\0';
-        } else {
-            int idx = 0;
-            while (size > 0 && idx < 15) {
-                size_str[idx++] = '0' + (size % 10);
-                size /= 10;
-            }
-            size_str[idx] = '\0';
+    char* dest = &fs_pool[fresh * FS_BLOCK_SIZE];
+    const char* src = &fs_pool[start * FS_BLOCK_SIZE];
+    for (vic_uint32 i = 0; i < count * FS_BLOCK_SIZE; i++) {
+        dest[i] = src[i];
+    }
 
-            // Reverse the string
-            for (int j = 0; j < idx / 2; j++) {
-                char temp = size_str[j];
-                size_str[j] = size_str[idx - j - 1];
-                size_str[idx - j - 1] = temp;
+    fs_block_put(start, count);
+    return fresh;
+}
+
+// Give a file private copies of shared blocks in [from, to) before they
+// are modified. Only the affected blocks are copied, splitting their
+// extent, while the file has extent slots to spare; otherwise the whole
+// extent is copied.
+// Returns VFS_OK, or VFS_ERR_NO_SPACE (the file's data is unchanged)
+static int fs_unshare(FSNode* node, vic_uint32 from, vic_uint32 to) {
+    vic_uint32 base = 0;
+    for (vic_uint32 i = 0; i < node->extent_count && base < to; i++) {
+        FSExtent* ext = &node->extents[i];
+        vic_uint32 end = base + ext->count * FS_BLOCK_SIZE;
+        if (from >= end) {
+            base = end;
+            continue;
+        }
+
+        // Blocks of this extent inside the range
+        vic_uint32 first = (from > base) ? (from - base) / FS_BLOCK_SIZE : 0;
+        vic_uint32 last = ((to < end ? to : end) - base - 1) / FS_BLOCK_SIZE;
+        bool shared = false;
+        for (vic_uint32 b = first; b <= last; b++) {
+            if (fs_block_refs[ext->start + b] > 1) {
+                shared = true;
+                break;
             }
         }
+        base = end;
+        if (!shared) {
+            continue;
+        }
 
-        kprint(size_str);
-        kprint(" bytes)\n");
+        vic_uint32 head = first;
+        vic_uint32 tail = ext->count - last - 1;
+        vic_uint32 extra = (head > 0) + (tail > 0);
+        if (node->extent_count + extra > FS_MAX_EXTENTS) {
+            int fresh = fs_copy_blocks(ext->start, ext->count);
+            if (fresh < 0) {
+                return VFS_ERR_NO_SPACE;
             }
+            ext->start = fresh;
+            continue;
+        }
+
+        int fresh = fs_copy_blocks(ext->start + first, last - first + 1);
+        if (fresh < 0) {
+            return VFS_ERR_NO_SPACE;
+        }
+
+        // Split into [head][copied blocks][tail]
+        FSExtent old = *ext;
+        for (vic_uint32 j = node->extent_count; j > i + 1; j--) {
+            node->extents[j - 1 + extra] = node->extents[j - 1];
+        }
+        node->extent_count += extra;
+
+        vic_uint32 k = i;
+        if (head > 0) {
+            node->extents[k].start = old.start;
+            node->extents[k].count = head;
+            k++;
+        }
+        node->extents[k].start = fresh;
+        node->extents[k].count = last - first + 1;
+        if (tail > 0) {
+            node->extents[k + 1].start = old.start + last + 1;
+            node->extents[k + 1].count = tail;
+        }
+        i += extra;
+    }
+    return VFS_OK;
+}
+
+// Point block k of extent i at another block holding the same bytes,
+// splitting the extent and merging the pieces with their neighbours
+// Returns false, changing nothing, if the file has no extent slots left
+static bool fs_remap_block(FSNode* node, vic_uint32 i, vic_uint32 k, vic_uint32 block) {
+    FSExtent old = node->extents[i];
+    FSExtent parts[5];
+    vic_uint32 count = 0;
+    vic_uint32 lo = i;
+    vic_uint32 hi = i;
+
+    if (i > 0) {
+        parts[count++] = node->extents[--lo];
+    }
+    if (k > 0) {
+        parts[count++] = {old.start, k};
+    }
+    parts[count++] = {block, 1};
+    if (k + 1 < old.count) {
+        parts[count++] = {old.start + k + 1, old.count - k - 1};
+    }
+    if (i + 1 < node->extent_count) {
+        parts[count++] = node->extents[++hi];
     }
 
-    if (!found) {
-        kprint("  [Empty directory]\n");
+    vic_uint32 merged = 0;
+    for (vic_uint32 j = 0; j < count; j++) {
+        if (merged > 0 && parts[merged - 1].start + parts[merged - 1].count == parts[j].start) {
+            parts[merged - 1].count += parts[j].count;
+        } else {
+            parts[merged++] = parts[j];
+        }
+    }
+
+    vic_uint32 replaced = hi - lo + 1;
+    if (node->extent_count - replaced + merged > FS_MAX_EXTENTS) {
+        return false;
+    }
+    if (merged > replaced) {
+        for (vic_uint32 j = node->extent_count; j > hi + 1; j--) {
+            node->extents[j - 1 + merged - replaced] = node->extents[j - 1];
+        }
+    } else {
+        for (vic_uint32 j = hi + 1; j < node->extent_count; j++) {
+            node->extents[j - (replaced - merged)] = node->extents[j];
+        }
+    }
+    for (vic_uint32 j = 0; j < merged; j++) {
+        node->extents[lo + j] = parts[j];
     }
+    node->extent_count = node->extent_count - replaced + merged;
+
+    fs_block_get(block, 1);
+    fs_block_put(old.start + k, 1);
+    return true;
 }
 
-// Create a directory
-vic_uint32 fs_mkdir(const char* path) {
-    // Parse path to get parent directory and new directory name
-    char parent_path[FS_MAX_PATH];
-    char dir_name[FS_MAX_FILENAME];
+// Deduplicate the blocks of a file that hold bytes in [from, to), which
+// were just written: each one is shared with an identical block already
+// in the pool, or indexed for later ones. Bytes past the end of the file
+// in its last block are zeroed first so that block compares whole.
+static void fs_dedup(FSNode* node, vic_uint32 from, vic_uint32 to) {
+    if (to > node->size) {
+        to = node->size;
+    }
+    if (from >= to) {
+        return;
+    }
+
+    for (vic_uint32 p = from / FS_BLOCK_SIZE; p <= (to - 1) / FS_BLOCK_SIZE; p++) {
+        // Find the extent holding file block p
+        vic_uint32 i = 0;
+        vic_uint32 k = p;
+        while (k >= node->extents[i].count) {
+            k -= node->extents[i].count;
+            i++;
+        }
+        vic_uint32 block = node->extents[i].start + k;
+        if (fs_block_refs[block] != 1) {
+            continue; // Shared already, and not written (fs_unshare)
+        }
 
-    // Find the last slash in the path
-    const char* last_slash = path;
-    const char* ptr = path;
+        char* data = &fs_pool[block * FS_BLOCK_SIZE];
+        vic_uint32 end = node->size - p * FS_BLOCK_SIZE;
+        for (vic_uint32 j = end; j < FS_BLOCK_SIZE; j++) {
+            data[j] = '\0';
+        }
 
-    while (*ptr) {
-        if (*ptr == '/') {
-            last_slash = ptr;
+        fs_dedup_forget(block);
+        vic_uint32 hash = fs_hash(0, data, FS_BLOCK_SIZE);
+        vic_int16 other = fs_dedup_heads[hash & (FS_DEDUP_BUCKETS - 1)];
+        for (; other != -1; other = fs_dedup_next[other]) {
+            if (fs_dedup_hash[other] != hash || fs_block_refs[other] == FS_MAX_REFS) {
+                continue;
+            }
+            const char* bytes = &fs_pool[other * FS_BLOCK_SIZE];
+            vic_uint32 j = 0;
+            while (j < FS_BLOCK_SIZE && bytes[j] == data[j]) {
+                j++;
+            }
+            if (j == FS_BLOCK_SIZE) {
+                break;
+            }
         }
-        ptr++;
+
+        if (other == -1 || !fs_remap_block(node, i, k, other)) {
+            fs_dedup_insert(block, hash);
+        }
+    }
+}
+
+// Binary-safe file data access by node index
+
+// Read file data
+// Returns bytes read (0 at end of file)
+int fs_read(vic_uint32 index, vic_uint32 offset, void* buf, vic_uint32 len) {
+    FSNode* node = &filesystem[index];
+    if (offset >= node->size) {
+        return 0;
+    }
+    if (len > node->size - offset) {
+        len = node->size - offset;
+    }
+
+    fs_data_copy(node, offset, (char*)buf, len, false);
+    return len;
+}
+
+// Write file data, growing the file as needed
+// Writing past the end leaves a zero-filled hole
+// Returns bytes written, or a negative VFS error
+int fs_write(vic_uint32 index, vic_uint32 offset, const void* buf, vic_uint32 len) {
+    FSNode* node = &filesystem[index];
+    if (offset + len < offset) {
+        return VFS_ERR_NO_SPACE;
+    }
+
+    vic_uint32 old_blocks = fs_node_blocks(node);
+    int result = fs_reserve(node, offset + len);
+    if (result < 0) {
+        return result;
+    }
+
+    // Modified blocks must not be shared (zero-filling a hole counts)
+    result = fs_unshare(node, offset < node->size ? offset : node->size, offset + len);
+    if (result < 0) {
+        fs_shrink_blocks(node, old_blocks);
+        return result;
+    }
+
+    if (offset > node->size) {
+        fs_data_zero(node, node->size, offset - node->size);
+    }
+    fs_data_copy(node, offset, (char*)buf, len, true);
+
+    vic_uint32 from = offset < node->size ? offset : node->size;
+    if (offset + len > node->size) {
+        node->size = offset + len;
     }
+    fs_dedup(node, from, offset + len);
+    return len;
+}
+
+// Append to a file; costs O(len), the existing data is not touched
+// Returns bytes written, or a negative VFS error
+int fs_append(vic_uint32 index, const void* buf, vic_uint32 len) {
+    return fs_write(index, filesystem[index].size, buf, len);
+}
 
-    // Extract parent path and directory name
-    if (last_slash == path) {
-        // Creating a directory in root
-        parent_path[0] = '/';
-        parent_path[1] = '\0';
-        fs_strcpy(dir_name, last_slash + 1);
+// Set the file size, zero-filling growth and freeing blocks past the end
+int fs_truncate(vic_uint32 index, vic_uint32 size) {
+    FSNode* node = &filesystem[index];
+
+    if (size > node->size) {
+        vic_uint32 old_blocks = fs_node_blocks(node);
+        int result = fs_reserve(node, size);
+        if (result >= 0) {
+            result = fs_unshare(node, node->size, size);
+        }
+        if (result < 0) {
+            fs_shrink_blocks(node, old_blocks);
+            return result;
+        }
+        fs_data_zero(node, node->size, size - node->size);
+
+        vic_uint32 from = node->size;
+        node->size = size;
+        fs_dedup(node, from, size);
     } else {
-        // Copy parent path
-        vic_size_t parent_len = last_slash - path;
-        for (vic_size_t i = 0; i < parent_len; i++) {
-            parent_path[i] = path[i];
+        fs_shrink_blocks(node, (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE);
+        node->size = size;
+    }
+    return VFS_OK;
+}
+
+// Make dst a copy of src by sharing src's blocks; data is only copied
+// for blocks that already have FS_MAX_REFS references
+int fs_clone(vic_uint32 src, vic_uint32 dst) {
+    FSNode* from = &filesystem[src];
+    FSNode* to = &filesystem[dst];
+    if (src == dst) {
+        return VFS_OK;
+    }
+
+    fs_shrink_blocks(to, 0);
+    for (vic_uint32 i = 0; i < from->extent_count; i++) {
+        FSExtent ext = from->extents[i];
+        bool full = false;
+        for (vic_uint32 b = ext.start; b < ext.start + ext.count; b++) {
+            if (fs_block_refs[b] == FS_MAX_REFS) {
+                full = true;
+                break;
+            }
         }
-        parent_path[parent_len] = '\0';
 
-        // Handle empty parent path (creating in root)
-        if (parent_path[0] == '\0') {
-            parent_path[0] = '/';
-            parent_path[1] = '\0';
+        // A run that can take no more references is copied instead
+        if (full) {
+            vic_uint32 fresh;
+            if (fs_find_free_run(ext.count, &fresh) != ext.count) {
+                fs_shrink_blocks(to, 0);
+                to->size = 0;
+                return VFS_ERR_NO_SPACE;
+            }
+            fs_block_get(fresh, ext.count);
+
+            char* dest = &fs_pool[fresh * FS_BLOCK_SIZE];
+            const char* data = &fs_pool[ext.start * FS_BLOCK_SIZE];
+            for (vic_uint32 j = 0; j < ext.count * FS_BLOCK_SIZE; j++) {
+                dest[j] = data[j];
+            }
+            ext.start = fresh;
+        } else {
+            fs_block_get(ext.start, ext.count);
         }
+        to->extents[i] = ext;
+        to->extent_count = i + 1;
+    }
+    to->size = from->size;
+    return VFS_OK;
+}
 
-        // Copy directory name
-        fs_strcpy(dir_name, last_slash + 1);
+// Allocate a node slot: find-first-zero over the bitmap words,
+// starting at the word that last had room
+// Returns the slot index, or -1 if the table is full
+static int fs_alloc_node() {
+    const vic_uint32 words = (fs_max_nodes + 31) / 32;
+
+    for (vic_uint32 n = 0; n < words; n++) {
+        vic_uint32 word = (fs_node_hint + n) % words;
+        if (fs_node_map[word] != 0xFFFFFFFF) {
+            vic_uint32 bit = __builtin_ctz(~fs_node_map[word]);
+            fs_node_map[word] |= 1u << bit;
+            fs_node_hint = word;
+            return word * 32 + bit;
+        }
     }
+    return -1;
+}
 
-    // Check if the directory name is empty
-    if (dir_name[0] == '\0') {
-        kprint("Error: Directory name cannot be empty\n");
-        return (vic_uint32)-1;
+// Return a node slot to the bitmap
+static void fs_free_node(vic_uint32 index) {
+    fs_node_map[index / 32] &= ~(1u << (index % 32));
+    filesystem[index].used = false;
+    fs_node_hint = index / 32;
+}
+
+// Link a node into its parent's child list, keeping it sorted by name
+static void fs_link_child(vic_uint32 index) {
+    FSNode* node = &filesystem[index];
+    vic_int32* link = &filesystem[node->parent_index].first_child;
+
+    while (*link != -1) {
+        const char* a = filesystem[*link].name;
+        const char* b = node->name;
+        while (*a && *a == *b) {
+            a++;
+            b++;
+        }
+        if ((vic_uint8)*a > (vic_uint8)*b) {
+            break;
+        }
+        link = &filesystem[*link].next_sibling;
     }
 
-    // Check if parent directory exists
-    int parent_index = fs_find_node(parent_path);
-    if (parent_index == -1) {
-        kprint("Error: Parent directory not found: ");
-        kprint(parent_path);
-        kprint("\n");
-        return (vic_uint32)-1;
+    node->next_sibling = *link;
+    *link = index;
+}
+
+// Unlink a node from its parent's child list
+static void fs_unlink_child(vic_uint32 index) {
+    vic_int32* link = &filesystem[filesystem[index].parent_index].first_child;
+    while (*link != (vic_int32)index) {
+        link = &filesystem[*link].next_sibling;
+    }
+    *link = filesystem[index].next_sibling;
+}
+
+// Create a node called name (len bytes) in directory parent
+// The caller has checked that no such child exists
+// Returns the new index, or a negative VFS error code
+static int fs_create_child(vic_uint32 parent, const char* name, vic_size_t len, vic_uint8 type) {
+    // Check the name fits
+    if (len == 0 || len >= FS_MAX_FILENAME) {
+        return VFS_ERR_INVALID;
+    }
+
+    // Take a free slot for the new node
+    int index = fs_alloc_node();
+    if (index == -1) {
+        return VFS_ERR_NO_SPACE;
+    }
+
+    // Create the node
+    for (vic_size_t i = 0; i < len; i++) {
+        filesystem[index].name[i] = name[i];
+    }
+    filesystem[index].name[len] = '\0';
+    filesystem[index].name_len = len;
+    filesystem[index].depth = filesystem[parent].depth + 1;
+    filesystem[index].type = type;
+    filesystem[index].size = 0;
+    filesystem[index].parent_index = parent;
+    filesystem[index].first_child = -1;
+    filesystem[index].extent_count = 0;
+    filesystem[index].used = true;
+    fs_index_insert(index);
+    fs_link_child(index);
+
+    return index;
+}
+
+// Create a node under an existing directory
+// Returns the new index, or a negative VFS error code
+int fs_create_node(const char* path, vic_uint8 type) {
+    FSResolve res;
+    int result = fs_resolve(path, FS_RESOLVE_CREATE, &res);
+    if (result < 0) {
+        return result;
+    }
+    if (res.node != -1) {
+        return VFS_ERR_EXISTS;
+    }
+
+    return fs_create_child(res.parent, res.name, res.name_len, type);
+}
+
+// Delete a file or an empty directory
+// Returns VFS_OK, or a negative VFS error code
+int fs_remove_node(vic_uint32 index) {
+    FSNode* node = &filesystem[index];
+    if (index == 0) {
+        return VFS_ERR_BUSY; // The root stays
+    }
+    if (node->type == FS_TYPE_DIRECTORY && node->first_child != -1) {
+        return VFS_ERR_NOT_EMPTY;
     }
 
-    if (filesystem[parent_index].type != FS_TYPE_DIRECTORY) {
-        kprint("Error: Parent is not a directory: ");
-        kprint(parent_path);
+    fs_shrink_blocks(node, 0);
+    fs_index_remove(index);
+    fs_unlink_child(index);
+    fs_free_node(index);
+    return VFS_OK;
+}
+
+// Create a directory
+vic_uint32 fs_mkdir(const char* path) {
+    int dir_index = fs_create_node(path, FS_TYPE_DIRECTORY);
+
+    if (dir_index < 0) {
+        kprint("Error: Failed to create directory ");
+        kprint(path);
+        kprint(": ");
+        kprint(vfs_strerror(dir_index));
         kprint("\n");
         return (vic_uint32)-1;
     }
 
-    // Check if directory already exists
-    char full_path[FS_MAX_PATH];
-    fs_strcpy(full_path, parent_path);
-    if (full_path[fs_strlen(full_path) - 1] != '/') {
-        fs_strcat(full_path, "/");
+    return dir_index;
+}
+
+// Create or update a file, replacing its content with len bytes
+vic_uint32 fs_touch(const char* path, const void* content, vic_uint32 len) {
+    FSResolve res;
+    int file_index = fs_resolve(path, FS_RESOLVE_CREATE, &res);
+    if (file_index >= 0) {
+        file_index = res.node;
+        if (file_index == -1) {
+            file_index = fs_create_child(res.parent, res.name, res.name_len, FS_TYPE_FILE);
+        }
     }
-    fs_strcat(full_path, dir_name);
 
-    if (fs_find_node(full_path) != -1) {
-        kprint("Error: Directory already exists: ");
-        kprint(full_path);
+    if (file_index < 0) {
+        kprint("Error: Failed to create file ");
+        kprint(path);
+        kprint(": ");
+        kprint(vfs_strerror(file_index));
+        kprint("\n");
+        return (vic_uint32)-1;
+    } else if (filesystem[file_index].type != FS_TYPE_FILE) {
+        kprint("Error: Path exists but is not a file: ");
+        kprint(path);
         kprint("\n");
         return (vic_uint32)-1;
     }
 
-    // Find free slot for the new directory
-    vic_uint32 dir_index = (vic_uint32)-1;
-    for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-        if (!filesystem[i].used) {
-            dir_index = i;
-            break;
+    // Update file content if provided
+    if (content) {
+        fs_truncate(file_index, 0);
+        if (fs_write(file_index, 0, content, len) < 0) {
+            kprint("Error: Content too large for file\n");
+            return (vic_uint32)-1;
         }
     }
 
-    if (dir_index == (vic_uint32)-1) {
-        kprint("Error: Filesystem full, cannot create directory\n");
-        return (vic_uint32)-1;
+    return file_index;
+}
+
+// Allocate the node table, block pool and their indexes, sized to memory
+// Returns false if even the smallest pool does not fit
+static bool fs_setup() {
+    if (filesystem) {
+        return true;
+    }
+
+    vic_uint32 order = pmm_order_for(pmm_total_pages() / FS_POOL_SHARE * PMM_PAGE_SIZE);
+    if (order > PMM_MAX_ORDER) {
+        order = PMM_MAX_ORDER;
+    }
+    if (order < FS_POOL_MIN_ORDER) {
+        order = FS_POOL_MIN_ORDER;
+    }
+    vic_uint32 pool = pmm_alloc_pages(order);
+    while (!pool && order > FS_POOL_MIN_ORDER) {
+        pool = pmm_alloc_pages(--order);
+    }
+    if (!pool) {
+        return false;
     }
 
-    // Create the directory
-    fs_strcpy(filesystem[dir_index].name, dir_name);
-    filesystem[dir_index].type = FS_TYPE_DIRECTORY;
-    filesystem[dir_index].size = 0;
-    filesystem[dir_index].parent_index = parent_index;
-    filesystem[dir_index].used = true;
+    vic_uint32 blocks = (PMM_PAGE_SIZE << order) / FS_BLOCK_SIZE;
+    vic_uint32 nodes = blocks / FS_BLOCKS_PER_NODE;
+    if (nodes < FS_MIN_NODES) {
+        nodes = FS_MIN_NODES;
+    }
+    vic_uint32 index_size = 1;
+    while (index_size < 2 * nodes) {
+        index_size <<= 1;
+    }
 
-    return dir_index;
+    // Everything else shares one allocation, widest fields first
+    vic_uint32 node_words = (nodes + 31) / 32;
+    vic_uint32 bytes = nodes * sizeof(FSNode) + node_words * sizeof(vic_uint32) +
+                       index_size * sizeof(FSIndexSlot) +
+                       blocks / 32 * 2 * sizeof(vic_uint32) + blocks * sizeof(vic_uint32) +
+                       blocks * 2 * sizeof(vic_int16) + blocks * sizeof(vic_uint16);
+    char* meta = (char*)kmalloc(bytes);
+    if (!meta) {
+        pmm_free_pages(pool, order);
+        return false;
+    }
+
+    filesystem = (FSNode*)meta;
+    meta += nodes * sizeof(FSNode);
+    fs_node_map = (vic_uint32*)meta;
+    meta += node_words * sizeof(vic_uint32);
+    fs_index = (FSIndexSlot*)meta;
+    meta += index_size * sizeof(FSIndexSlot);
+    fs_block_map = (vic_uint32*)meta;
+    meta += blocks / 32 * sizeof(vic_uint32);
+    fs_dedup_map = (vic_uint32*)meta;
+    meta += blocks / 32 * sizeof(vic_uint32);
+    fs_dedup_hash = (vic_uint32*)meta;
+    meta += blocks * sizeof(vic_uint32);
+    fs_dedup_prev = (vic_int16*)meta;
+    meta += blocks * sizeof(vic_int16);
+    fs_dedup_next = (vic_int16*)meta;
+    meta += blocks * sizeof(vic_int16);
+    fs_block_refs = (vic_uint16*)meta;
+
+    fs_pool = (char*)(vic_uintptr)pool;
+    fs_pool_blocks = blocks;
+    fs_max_nodes = nodes;
+    fs_index_size = index_size;
+    return true;
 }
 
-// Create or update a file
-vic_uint32 fs_touch(const char* path, const char* content) {
-    // Parse path to get parent directory and filename
-    char parent_path[FS_MAX_PATH];
-    char file_name[FS_MAX_FILENAME];
+// Empty the filesystem down to a bare root directory
+static void fs_reset() {
+    // Initialize all entries as unused
+    for (vic_uint32 i = 0; i < fs_max_nodes; i++) {
+        filesystem[i].used = false;
+        filesystem[i].first_child = -1;
+    }
+    for (vic_uint32 i = 0; i < fs_index_size; i++) {
+        fs_index[i].node = -1;
+    }
+    for (vic_uint32 i = 0; i < fs_pool_blocks / 32; i++) {
+        fs_block_map[i] = 0;
+    }
+    for (vic_uint32 i = 0; i < fs_pool_blocks; i++) {
+        fs_block_refs[i] = 0;
+    }
+    for (vic_uint32 i = 0; i < fs_pool_blocks / 32; i++) {
+        fs_dedup_map[i] = 0;
+    }
+    for (vic_uint32 i = 0; i < FS_DEDUP_BUCKETS; i++) {
+        fs_dedup_heads[i] = -1;
+    }
+    for (vic_uint32 i = 0; i < (fs_max_nodes + 31) / 32; i++) {
+        fs_node_map[i] = 0;
+    }
+    for (vic_uint32 i = fs_max_nodes; i < ((fs_max_nodes + 31) / 32) * 32; i++) {
+        fs_node_map[i / 32] |= 1u << (i % 32); // Slots past the table never free
+    }
+    fs_node_map[0] |= 1; // Root
+    fs_node_hint = 0;
 
-    // Find the last slash in the path
-    const char* last_slash = path;
-    const char* ptr = path;
+    // Set up the root directory
+    fs_strcpy(filesystem[0].name, "/");
+    filesystem[0].type = FS_TYPE_DIRECTORY;
+    filesystem[0].size = 0;
+    filesystem[0].parent_index = 0; // Root is its own parent
+    filesystem[0].name_len = 1;
+    filesystem[0].depth = 0;
+    filesystem[0].next_sibling = -1;
+    filesystem[0].extent_count = 0;
+    filesystem[0].used = true;
+}
 
-    while (*ptr) {
-        if (*ptr == '/') {
-            last_slash = ptr;
-        }
-        ptr++;
+// Initialize the filesystem
+void fs_init() {
+    if (!fs_setup()) {
+        kprint("Filesystem: not enough memory\n");
+        return;
     }
+    fs_reset();
 
-    // Extract parent path and file name
-    if (last_slash == path) {
-        // Creating a file in root
-        parent_path[0] = '/';
-        parent_path[1] = '\0';
-        fs_strcpy(file_name, last_slash + 1);
-    } else {
-        // Copy parent path
-        vic_size_t parent_len = last_slash - path;
-        for (vic_size_t i = 0; i < parent_len; i++) {
-            parent_path[i] = path[i];
-        }
-        parent_path[parent_len] = '\0';
+    // Create a few default directories
+    fs_mkdir("/bin");
+    fs_mkdir("/home");
+    fs_mkdir("/etc");
+
+    // Create some default files
+    const char* motd = "Welcome to VicOS Filesystem!\n";
+    const char* readme = "This is your home directory.\n";
+    fs_touch("/etc/motd", motd, fs_strlen(motd));
+    fs_touch("/home/readme.txt", readme, fs_strlen(readme));
+
+    kprint("Filesystem initialized.\n");
+}
+
+// Snapshot image: a header, then one record per node in slot order, each
+// file's data straight after its record. The checksum covers everything
+// after the header.
+#define FS_SNAPSHOT_MAGIC "VICFSIMG"
+#define FS_SNAPSHOT_VERSION 1
+
+struct FSSnapshotHeader {
+    char magic[8];
+    vic_uint32 version;
+    vic_uint32 node_count;
+    vic_uint32 image_size;    // Bytes after the header
+    vic_uint32 checksum;      // CRC-32
+};
 
-        // Handle empty parent path (creating in root)
-        if (parent_path[0] == '\0') {
-            parent_path[0] = '/';
-            parent_path[1] = '\0';
+struct FSSnapshotRecord {
+    vic_uint32 index;
+    vic_uint32 parent_index;
+    vic_uint32 size;
+    vic_uint8 type;
+    vic_uint8 name_len;
+    vic_uint8 depth;
+    vic_uint8 reserved;
+    char name[FS_MAX_FILENAME];
+};
+
+// Staging buffer for reading images back
+#define FS_SNAPSHOT_CHUNK 4096
+char fs_snapshot_buf[FS_SNAPSHOT_CHUNK];
+
+// CRC-32 (IEEE) lookup table, built on first use
+vic_uint32 fs_crc_table[256];
+bool fs_crc_ready = false;
+
+vic_uint32 fs_crc32(vic_uint32 crc, const void* data, vic_uint32 len) {
+    if (!fs_crc_ready) {
+        for (vic_uint32 i = 0; i < 256; i++) {
+            vic_uint32 c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            fs_crc_table[i] = c;
         }
+        fs_crc_ready = true;
+    }
 
-        // Copy file name
-        fs_strcpy(file_name, last_slash + 1);
+    const vic_uint8* bytes = (const vic_uint8*)data;
+    for (vic_uint32 i = 0; i < len; i++) {
+        crc = fs_crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
     }
+    return crc;
+}
 
-    // Check if the file name is empty
-    if (file_name[0] == '\0') {
-        kprint("Error: File name cannot be empty\n");
-        return (vic_uint32)-1;
+// Write to a snapshot image, folding the bytes into the checksum
+static int fs_snapshot_put(int fd, const void* data, vic_uint32 len, vic_uint32* crc) {
+    int written = vfs_write(fd, data, len);
+    if (written < 0) {
+        return written;
     }
+    if ((vic_uint32)written != len) {
+        return VFS_ERR_NO_SPACE;
+    }
+    *crc = fs_crc32(*crc, data, len);
+    return VFS_OK;
+}
 
-    // Check if parent directory exists
-    int parent_index = fs_find_node(parent_path);
-    if (parent_index == -1) {
-        kprint("Error: Parent directory not found: ");
-        kprint(parent_path);
-        kprint("\n");
-        return (vic_uint32)-1;
+// Read exactly len bytes of a snapshot image
+static int fs_snapshot_get(int fd, void* data, vic_uint32 len) {
+    int count = vfs_read(fd, data, len);
+    if (count < 0) {
+        return count;
     }
+    return ((vic_uint32)count == len) ? VFS_OK : VFS_ERR_INVALID;
+}
 
-    if (filesystem[parent_index].type != FS_TYPE_DIRECTORY) {
-        kprint("Error: Parent is not a directory: ");
-        kprint(parent_path);
-        kprint("\n");
-        return (vic_uint32)-1;
+// Save the whole RAM filesystem as one image file
+// The image must live on another filesystem (e.g. /disk)
+// Returns VFS_OK, or a negative VFS error code
+int fs_snapshot(const char* path) {
+    if (vfs_get_ops(path) == &ramfs_vfs_ops) {
+        return VFS_ERR_INVALID;
     }
 
-    // Check if file already exists
-    char full_path[FS_MAX_PATH];
-    fs_strcpy(full_path, parent_path);
-    if (full_path[fs_strlen(full_path) - 1] != '/') {
-        fs_strcat(full_path, "/");
+    // Data still sitting in the page cache belongs in the image
+    int result = vfs_sync();
+    if (result < 0) {
+        return result;
     }
-    fs_strcat(full_path, file_name);
 
-    int file_index = fs_find_node(full_path);
+    int fd = vfs_open(path, VFS_O_WRITE | VFS_O_CREATE | VFS_O_TRUNC);
+    if (fd < 0) {
+        return fd;
+    }
 
-    if (file_index != -1) {
-        // File exists, check if it's a file
-        if (filesystem[file_index].type != FS_TYPE_FILE) {
-            kprint("Error: Path exists but is not a file: ");
-            kprint(full_path);
-            kprint("\n");
-            return (vic_uint32)-1;
+    // Leave room for the header; it is filled in once the checksum is known
+    FSSnapshotHeader header;
+    for (vic_uint32 i = 0; i < sizeof(header); i++) {
+        ((char*)&header)[i] = '\0';
+    }
+    result = vfs_write(fd, &header, sizeof(header));
+
+    vic_uint32 crc = 0xFFFFFFFF;
+    vic_uint32 start = sizeof(header);
+    for (vic_uint32 i = 0; i < fs_max_nodes && result >= 0; i++) {
+        FSNode* node = &filesystem[i];
+        if (!node->used) {
+            continue;
         }
 
-        // Update file content if provided
-        if (content) {
-            vic_size_t content_len = fs_strlen(content);
-            if (content_len >= FS_MAX_FILE_SIZE) {
-                kprint("Error: Content too large for file\n");
-                return (vic_uint32)-1;
+        FSSnapshotRecord record;
+        record.index = i;
+        record.parent_index = node->parent_index;
+        record.size = node->size;
+        record.type = node->type;
+        record.name_len = node->name_len;
+        record.depth = node->depth;
+        record.reserved = 0;
+        for (vic_uint32 j = 0; j < FS_MAX_FILENAME; j++) {
+            record.name[j] = (j < node->name_len) ? node->name[j] : '\0';
+        }
+        result = fs_snapshot_put(fd, &record, sizeof(record), &crc);
+        header.node_count++;
+
+        // File data goes out one extent run at a time
+        vic_uint32 pos = 0;
+        while (result >= 0 && pos < node->size) {
+            vic_uint32 run;
+            const char* data = fs_data_ptr(node, pos, &run);
+            if (run > node->size - pos) {
+                run = node->size - pos;
             }
+            result = fs_snapshot_put(fd, data, run, &crc);
+            pos += run;
+        }
+    }
+
+    if (result >= 0) {
+        vic_uint32 end = vfs_size(fd);
+        for (int i = 0; i < 8; i++) {
+            header.magic[i] = FS_SNAPSHOT_MAGIC[i];
+        }
+        header.version = FS_SNAPSHOT_VERSION;
+        header.image_size = end - start;
+        header.checksum = ~crc;
+
+        result = vfs_seek(fd, 0);
+        if (result >= 0) {
+            result = vfs_write(fd, &header, sizeof(header));
+        }
+        if (result >= 0) {
+            result = vfs_fsync(fd);
+        }
+    }
+
+    int closed = vfs_close(fd);
+    return (result < 0) ? result : closed;
+}
+
+// Read the checksum identifying a snapshot image
+int fs_snapshot_checksum(const char* path, vic_uint32* checksum) {
+    int fd = vfs_open(path, VFS_O_READ);
+    if (fd < 0) {
+        return fd;
+    }
+
+    FSSnapshotHeader header;
+    int result = fs_snapshot_get(fd, &header, sizeof(header));
+    for (int i = 0; i < 8 && result >= 0; i++) {
+        if (header.magic[i] != FS_SNAPSHOT_MAGIC[i]) {
+            result = VFS_ERR_INVALID;
+        }
+    }
+    vfs_close(fd);
+
+    if (result >= 0) {
+        *checksum = header.checksum;
+    }
+    return result;
+}
 
-            fs_strcpy(filesystem[file_index].content, content);
-            filesystem[file_index].size = content_len;
+// Replace the RAM filesystem with a snapshot image
+// Every record and the checksum are verified before anything is replaced,
+// so a corrupt image leaves the current tree untouched. The tree is then
+// rebuilt in one sequential pass; if that runs out of blocks or hits a
+// read error the default tree is set up instead.
+// Returns VFS_OK, or a negative VFS error code
+int fs_restore(const char* path) {
+    int fd = vfs_open(path, VFS_O_READ);
+    if (fd < 0) {
+        return fd;
+    }
+
+    FSSnapshotHeader header;
+    int result = fs_snapshot_get(fd, &header, sizeof(header));
+    for (int i = 0; i < 8 && result >= 0; i++) {
+        if (header.magic[i] != FS_SNAPSHOT_MAGIC[i]) {
+            result = VFS_ERR_INVALID;
         }
+    }
+    if (result >= 0 && (header.version != FS_SNAPSHOT_VERSION ||
+                        header.node_count == 0 || header.node_count > fs_max_nodes ||
+                        (vic_uint32)vfs_size(fd) != sizeof(header) + header.image_size)) {
+        result = VFS_ERR_INVALID;
+    }
 
-        return file_index;
+    // Pass 1: walk every record and verify the checksum, so that a bad
+    // image is turned away before the current tree is touched. Names and
+    // parents are kept to check (parent, name) pairs and parent chains.
+    vic_uint32 words = (fs_max_nodes + 31) / 32;
+    vic_uint32* seen = (vic_uint32*)kmalloc((2 * words + 2 * fs_max_nodes + fs_index_size) *
+                                            sizeof(vic_uint32) + fs_max_nodes * FS_MAX_FILENAME);
+    if (!seen) {
+        vfs_close(fd);
+        return VFS_ERR_NO_SPACE;
     }
+    vic_uint32* dirs = seen + words;
+    vic_uint32* parents = dirs + words;
+    vic_uint32* depths = parents + fs_max_nodes;
+    vic_int32* slots = (vic_int32*)(depths + fs_max_nodes);
+    char* names = (char*)(slots + fs_index_size);
+    for (vic_uint32 i = 0; i < 2 * words; i++) {
+        seen[i] = 0;
+    }
+    for (vic_uint32 i = 0; i < fs_index_size; i++) {
+        slots[i] = -1;
+    }
+    vic_uint32 crc = 0xFFFFFFFF;
+    vic_uint32 remaining = header.image_size;
+    for (vic_uint32 n = 0; n < header.node_count && result >= 0; n++) {
+        FSSnapshotRecord record;
+        if (remaining < sizeof(record)) {
+            result = VFS_ERR_INVALID;
+            break;
+        }
+        result = fs_snapshot_get(fd, &record, sizeof(record));
+        if (result < 0) {
+            break;
+        }
+        crc = fs_crc32(crc, &record, sizeof(record));
+        remaining -= sizeof(record);
+
+        if (record.index >= fs_max_nodes || record.parent_index >= fs_max_nodes ||
+            record.name_len == 0 || record.name_len >= FS_MAX_FILENAME ||
+            (record.type != FS_TYPE_FILE && record.type != FS_TYPE_DIRECTORY) ||
+            (record.index == 0) != (n == 0) ||
+            (n == 0 && record.type != FS_TYPE_DIRECTORY) ||
+            (n == 0 && (record.parent_index != 0 || record.name_len != 1 || record.name[0] != '/')) ||
+            (seen[record.index / 32] & (1u << (record.index % 32))) ||
+            (record.type == FS_TYPE_DIRECTORY && record.size != 0) ||
+            record.size > remaining) {
+            result = VFS_ERR_INVALID;
+            break;
+        }
 
-    // Find free slot for the new file
-    vic_uint32 new_file_index = (vic_uint32)-1;
-    for (vic_uint32 i = 0; i < FS_MAX_FILES + FS_MAX_DIRS; i++) {
-        if (!filesystem[i].used) {
-            new_file_index = i;
+        // Names are path components: no separators or terminators inside
+        char* name = &names[record.index * FS_MAX_FILENAME];
+        for (vic_uint32 j = 0; j < record.name_len; j++) {
+            if (record.name[j] == '\0' || (record.name[j] == '/' && n != 0)) {
+                result = VFS_ERR_INVALID;
+            }
+            name[j] = record.name[j];
+        }
+        name[record.name_len] = '\0';
+
+        // No two children of one directory may share a name
+        if (result >= 0 && n != 0) {
+            vic_uint32 pos = fs_hash(record.parent_index, name, record.name_len);
+            for (pos &= fs_index_size - 1; slots[pos] != -1; pos = (pos + 1) & (fs_index_size - 1)) {
+                if (parents[slots[pos]] == record.parent_index &&
+                    fs_name_equals(&names[slots[pos] * FS_MAX_FILENAME], name, record.name_len)) {
+                    result = VFS_ERR_INVALID;
+                    break;
+                }
+            }
+            slots[pos] = record.index;
+        }
+        if (result < 0) {
             break;
         }
+        seen[record.index / 32] |= 1u << (record.index % 32);
+        if (record.type == FS_TYPE_DIRECTORY) {
+            dirs[record.index / 32] |= 1u << (record.index % 32);
+        }
+        parents[record.index] = record.parent_index;
+
+        vic_uint32 left = record.size;
+        while (result >= 0 && left > 0) {
+            vic_uint32 chunk = (left > FS_SNAPSHOT_CHUNK) ? FS_SNAPSHOT_CHUNK : left;
+            result = fs_snapshot_get(fd, fs_snapshot_buf, chunk);
+            crc = fs_crc32(crc, fs_snapshot_buf, chunk);
+            left -= chunk;
+        }
+        remaining -= record.size;
+    }
+    if (result >= 0 && (remaining != 0 || ~crc != header.checksum)) {
+        result = VFS_ERR_INVALID;
     }
 
-    if (new_file_index == (vic_uint32)-1) {
-        kprint("Error: Filesystem full, cannot create file\n");
-        return (vic_uint32)-1;
+    // Every node must reach the root through directories in the image,
+    // within node_count steps (so without a cycle) and with a path that
+    // fits; the depth is taken from that walk, not from the record
+    depths[0] = 0;
+    for (vic_uint32 i = 1; i < fs_max_nodes && result >= 0; i++) {
+        if (!(seen[i / 32] & (1u << (i % 32)))) {
+            continue;
+        }
+        vic_uint32 current = i;
+        vic_uint32 depth = 0;
+        vic_uint32 len = 0;
+        while (current != 0 && depth < header.node_count) {
+            vic_uint32 parent = parents[current];
+            if (!(dirs[parent / 32] & (1u << (parent % 32)))) {
+                break;
+            }
+            len += fs_strlen(&names[current * FS_MAX_FILENAME]) + 1;
+            current = parent;
+            depth++;
+        }
+        if (current != 0 || depth > 0xFF || len >= FS_MAX_PATH) {
+            result = VFS_ERR_INVALID;
+        }
+        depths[i] = depth;
+    }
+    if (result >= 0) {
+        result = vfs_drop_cache("/"); // Fails while RAM FS files are open
+    }
+    if (result < 0) {
+        kfree(seen);
+        vfs_close(fd);
+        return result;
     }
 
-    // Create the file
-    fs_strcpy(filesystem[new_file_index].name, file_name);
-    filesystem[new_file_index].type = FS_TYPE_FILE;
-    filesystem[new_file_index].parent_index = parent_index;
-    filesystem[new_file_index].used = true;
+    // Pass 2: rebuild the node table, index, child lists and data from
+    // the records checked above
+    fs_reset();
+    vfs_seek(fd, sizeof(header));
+    for (vic_uint32 n = 0; n < header.node_count && result >= 0; n++) {
+        FSSnapshotRecord record;
+        result = fs_snapshot_get(fd, &record, sizeof(record));
+        if (result < 0) {
+            break;
+        }
 
-    // Set content if provided
-    if (content) {
-        vic_size_t content_len = fs_strlen(content);
-        if (content_len >= FS_MAX_FILE_SIZE) {
-            kprint("Error: Content too large for file\n");
-            filesystem[new_file_index].used = false;
-            return (vic_uint32)-1;
+        FSNode* node = &filesystem[record.index];
+        for (vic_uint32 j = 0; j < record.name_len; j++) {
+            node->name[j] = record.name[j];
+        }
+        node->name[record.name_len] = '\0';
+        node->name_len = record.name_len;
+        node->type = record.type;
+        node->size = 0;
+        node->parent_index = record.parent_index;
+        node->depth = depths[record.index];
+        node->extent_count = 0;
+        node->used = true;
+        fs_node_map[record.index / 32] |= 1u << (record.index % 32);
+
+        if (record.index != 0) {
+            fs_index_insert(record.index);
+            fs_link_child(record.index);
         }
 
-        fs_strcpy(filesystem[new_file_index].content, content);
-        filesystem[new_file_index].size = content_len;
-    } else {
-        // Empty file
-        filesystem[new_file_index].content[0] = '\0';
-        filesystem[new_file_index].size = 0;
+        // Data follows its record
+        vic_uint32 pos = 0;
+        while (result >= 0 && pos < record.size) {
+            vic_uint32 chunk = record.size - pos;
+            if (chunk > FS_SNAPSHOT_CHUNK) {
+                chunk = FS_SNAPSHOT_CHUNK;
+            }
+            result = fs_snapshot_get(fd, fs_snapshot_buf, chunk);
+            if (result >= 0) {
+                result = fs_write(record.index, pos, fs_snapshot_buf, chunk);
+            }
+            pos += chunk;
+        }
+    }
+
+    kfree(seen);
+    vfs_close(fd);
+
+    // Only a read error or a full block pool can stop the rebuild now;
+    // leave the default tree rather than half of the image
+    if (result < 0) {
+        fs_init();
+    }
+
+    // The working directory may not exist in the restored tree
+    if (vfs_chdir(vfs_getcwd()) < 0) {
+        vfs_chdir("/");
     }
+    return result < 0 ? result : VFS_OK;
+}
 
-    return new_file_index;
+// VFS backend: the RAM filesystem mounted at "/"
+
+static void ramfs_fill_vnode(int index, VNode* node) {
+    node->ino = index;
+    node->type = filesystem[index].type;
+    node->size = filesystem[index].size;
 }
 
-// Read file content
-const char* fs_read(const char* path) {
-    int file_index = fs_find_node(path);
+static int ramfs_mount(VfsMount* /* mnt */) {
+    // fs_init() has already built the tree, unless it ran out of memory
+    return filesystem ? VFS_OK : VFS_ERR_NO_SPACE;
+}
 
-    if (file_index == -1) {
-        kprint("Error: File not found: ");
-        kprint(path);
-        kprint("\n");
-        return nullptr;
+static int ramfs_lookup(VfsMount* /* mnt */, const char* path, VNode* node) {
+    FSResolve res;
+    int result = fs_resolve(path, 0, &res);
+    if (result < 0) {
+        return result;
     }
+    ramfs_fill_vnode(res.node, node);
+    return VFS_OK;
+}
 
-    if (filesystem[file_index].type != FS_TYPE_FILE) {
-        kprint("Error: Not a file: ");
-        kprint(path);
-        kprint("\n");
-        return nullptr;
+static int ramfs_create(VfsMount* /* mnt */, const char* path, VNode* node) {
+    int index = fs_create_node(path, FS_TYPE_FILE);
+    if (index < 0) {
+        return index;
     }
+    fs_log_create(path, FS_TYPE_FILE);
+    ramfs_fill_vnode(index, node);
+    return VFS_OK;
+}
 
-    return filesystem[file_index].content;
+static int ramfs_mkdir(VfsMount* /* mnt */, const char* path) {
+    int index = fs_create_node(path, FS_TYPE_DIRECTORY);
+    if (index < 0) {
+        return index;
+    }
+    fs_log_create(path, FS_TYPE_DIRECTORY);
+    return VFS_OK;
 }
 
-// Get current directory path
-const char* fs_pwd() {
-    return current_path;
+static int ramfs_remove(VfsMount* /* mnt */, const char* path) {
+    FSResolve res;
+    int result = fs_resolve(path, 0, &res);
+    if (result < 0) {
+        return result;
+    }
+    result = fs_remove_node(res.node);
+    if (result >= 0) {
+        fs_log_remove(path);
+    }
+    return result;
 }
+
+static int ramfs_read(VNode* node, vic_uint32 offset, void* buf, vic_uint32 len) {
+    return fs_read(node->ino, offset, buf, len);
+}
+
+static int ramfs_write(VNode* node, vic_uint32 offset, const void* buf, vic_uint32 len) {
+    int written = fs_write(node->ino, offset, buf, len);
+    if (written > 0) {
+        fs_log_write(node->path, offset, buf, written);
+    }
+    return written;
+}
+
+static int ramfs_truncate(VNode* node, vic_uint32 size) {
+    int result = fs_truncate(node->ino, size);
+    if (result >= 0) {
+        fs_log_truncate(node->path, size);
+    }
+    return result;
+}
+
+static int ramfs_clone(VNode* src, VNode* dst) {
+    int result = fs_clone(src->ino, dst->ino);
+    if (result >= 0) {
+        fs_log_clone(src->path, dst->path);
+    }
+    return result;
+}
+
+static int ramfs_opendir(VNode* node, VfsFile* dir) {
+    // Cursor is the next child to return, fs_max_nodes at the end
+    vic_int32 first = filesystem[node->ino].first_child;
+    dir->offset = (first == -1) ? fs_max_nodes : first;
+    return VFS_OK;
+}
+
+static int ramfs_readdir(VNode* /* node */, VfsFile* dir, VfsDirEntry* entry) {
+    if (dir->offset >= fs_max_nodes) {
+        return 0;
+    }
+
+    FSNode* child = &filesystem[dir->offset];
+    fs_strcpy(entry->name, child->name);
+    entry->type = child->type;
+    entry->size = child->size;
+
+    dir->offset = (child->next_sibling == -1) ? fs_max_nodes : child->next_sibling;
+    return 1;
+}
+
+static void ramfs_closedir(VNode* /* node */, VfsFile* /* dir */) {
+}
+
+// File content is already in memory, hand it over one extent at a time
+static int ramfs_stream(VNode* node, vic_uint32 offset, VfsSink sink) {
+    FSNode* file = &filesystem[node->ino];
+    vic_uint32 pos = offset;
+
+    while (pos < file->size) {
+        vic_uint32 run;
+        const char* data = fs_data_ptr(file, pos, &run);
+        if (run > file->size - pos) {
+            run = file->size - pos;
+        }
+        sink(data, run);
+        pos += run;
+    }
+
+    return pos > offset ? pos - offset : 0;
+}
+
+const VfsOps ramfs_vfs_ops = {
+    "ramfs",
+    ramfs_mount,
+    nullptr,
+    ramfs_lookup,
+    ramfs_create,
+    ramfs_mkdir,
+    ramfs_remove,
+    ramfs_read,
+    ramfs_write,
+    ramfs_truncate,
+    ramfs_opendir,
+    ramfs_readdir,
+    ramfs_closedir,
+    nullptr,
+    ramfs_stream,
+    nullptr,
+    ramfs_clone
+};
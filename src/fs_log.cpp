@@ -0,0 +1,466 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "vfs.h"
+
+// Write-ahead log for the RAM filesystem. Every change the RAM FS backend
+// makes (create, write range, truncate, remove) is appended to an in-memory
+// buffer; a commit appends the whole buffer to the log file in one
+// sequential write. Once the log grows past FS_LOG_CHECKPOINT_SIZE the tree
+// is checkpointed into a snapshot image and the log starts over. Attaching
+// restores the image and replays the log on top of it.
+//
+// Checkpoints alternate between two images, the given path and the same
+// path with FS_LOG_ALT_SUFFIX, so the image the log is based on stays whole
+// while the next one is written. Only then is the log header rewritten in
+// place to name the new image and a new generation. Records carry the
+// generation in their checksums, so the previous generation's records
+// still in the file stop replay rather than being applied twice.
+
+// Forward declarations from filesystem.cpp
+int fs_create_node(const char* path, vic_uint8 type);
+int fs_find_node(const char* path);
+int fs_remove_node(vic_uint32 index);
+int fs_write(vic_uint32 index, vic_uint32 offset, const void* buf, vic_uint32 len);
+int fs_truncate(vic_uint32 index, vic_uint32 size);
+int fs_clone(vic_uint32 src, vic_uint32 dst);
+int fs_snapshot(const char* path);
+int fs_restore(const char* path);
+int fs_snapshot_checksum(const char* path, vic_uint32* checksum);
+vic_uint32 fs_crc32(vic_uint32 crc, const void* data, vic_uint32 len);
+
+#define FS_LOG_MAGIC "VICFSLOG"
+#define FS_LOG_VERSION 2
+
+// Appended to the image path to name the second image
+#define FS_LOG_ALT_SUFFIX ".1"
+
+// Records waiting for the next commit
+#define FS_LOG_BUFFER_SIZE 32768
+
+// Largest data payload of one write record
+#define FS_LOG_CHUNK 4096
+
+// Log size that triggers a checkpoint
+#define FS_LOG_CHECKPOINT_SIZE (256 * 1024)
+
+// Record types
+#define FS_LOG_CREATE   1
+#define FS_LOG_WRITE    2
+#define FS_LOG_TRUNCATE 3
+#define FS_LOG_REMOVE   4
+#define FS_LOG_COMMIT   5     // Ends a batch
+#define FS_LOG_CLONE    6     // Data is the source path
+
+// Start of the log file; base ties the log to the image it follows
+struct FSLogHeader {
+    char magic[8];
+    vic_uint32 version;
+    vic_uint32 base;          // Checksum of the snapshot image
+    vic_uint32 generation;    // Bumped by every checkpoint
+};
+
+// One log record, followed by path_len bytes of path and len bytes of data
+struct FSLogRecord {
+    vic_uint8 op;
+    vic_uint8 type;           // Node type for FS_LOG_CREATE
+    vic_uint16 path_len;
+    vic_uint32 offset;        // Write offset, or new size for FS_LOG_TRUNCATE
+    vic_uint32 len;           // Data bytes for FS_LOG_WRITE
+    vic_uint32 checksum;      // CRC-32 of the generation, the record (checksum
+                              // zeroed), path and data
+};
+
+char fs_log_path[VFS_MAX_PATH];
+char fs_log_images[2][VFS_MAX_PATH];
+vic_uint32 fs_log_slot = 0;         // Image the log is based on
+vic_uint32 fs_log_generation = 0;
+
+bool fs_log_active = false;      // Changes are being recorded
+bool fs_log_committing = false;  // A commit is writing the buffer out
+bool fs_log_overflow = false;    // A record was dropped; only a checkpoint recovers
+
+char fs_log_buffer[FS_LOG_BUFFER_SIZE];
+vic_uint32 fs_log_used = 0;
+
+// Length of the log up to the end of the last batch known to be on disk.
+// Commits always write from here, so a failed one is overwritten rather
+// than left as torn bytes that would stop replay.
+vic_uint32 fs_log_committed = 0;
+
+// Staging for replay
+char fs_log_data[FS_LOG_CHUNK];
+
+static vic_uint32 fs_log_strlen(const char* str) {
+    vic_uint32 len = 0;
+    while (str[len]) {
+        len++;
+    }
+    return len;
+}
+
+static void fs_log_copy(char* dest, const char* src, vic_uint32 len) {
+    for (vic_uint32 i = 0; i < len; i++) {
+        dest[i] = src[i];
+    }
+}
+
+// Queue one record for the next commit
+static void fs_log_append(vic_uint8 op, vic_uint8 type, const char* path,
+                          vic_uint32 offset, const void* data, vic_uint32 len) {
+    if (!fs_log_active || fs_log_overflow) {
+        return;
+    }
+
+    vic_uint32 reserve = (op == FS_LOG_COMMIT) ? 0 : sizeof(FSLogRecord);
+    vic_uint32 path_len = fs_log_strlen(path);
+    vic_uint32 total = sizeof(FSLogRecord) + path_len + len;
+
+    // Records usually arrive from page cache writeback, where committing
+    // would re-enter the cache. A batch too big for the buffer is cheaper
+    // to checkpoint than to log anyway.
+    if (fs_log_used + total + reserve > FS_LOG_BUFFER_SIZE) {
+        fs_log_overflow = true;
+        return;
+    }
+
+    FSLogRecord record;
+    record.op = op;
+    record.type = type;
+    record.path_len = path_len;
+    record.offset = offset;
+    record.len = len;
+    record.checksum = 0;
+
+    vic_uint32 crc = fs_crc32(0xFFFFFFFF, &fs_log_generation, sizeof(fs_log_generation));
+    crc = fs_crc32(crc, &record, sizeof(record));
+    crc = fs_crc32(crc, path, path_len);
+    crc = fs_crc32(crc, data, len);
+    record.checksum = ~crc;
+
+    char* out = fs_log_buffer + fs_log_used;
+    fs_log_copy(out, (const char*)&record, sizeof(record));
+    fs_log_copy(out + sizeof(record), path, path_len);
+    fs_log_copy(out + sizeof(record) + path_len, (const char*)data, len);
+    fs_log_used += total;
+}
+
+// Hooks called by the RAM FS backend after each successful change
+void fs_log_create(const char* path, vic_uint8 type) {
+    fs_log_append(FS_LOG_CREATE, type, path, 0, nullptr, 0);
+}
+
+void fs_log_write(const char* path, vic_uint32 offset, const void* buf, vic_uint32 len) {
+    const char* data = (const char*)buf;
+    for (vic_uint32 done = 0; done < len; done += FS_LOG_CHUNK) {
+        vic_uint32 chunk = (len - done > FS_LOG_CHUNK) ? FS_LOG_CHUNK : len - done;
+        fs_log_append(FS_LOG_WRITE, 0, path, offset + done, data + done, chunk);
+    }
+}
+
+void fs_log_truncate(const char* path, vic_uint32 size) {
+    fs_log_append(FS_LOG_TRUNCATE, 0, path, size, nullptr, 0);
+}
+
+void fs_log_remove(const char* path) {
+    fs_log_append(FS_LOG_REMOVE, 0, path, 0, nullptr, 0);
+}
+
+void fs_log_clone(const char* src, const char* dst) {
+    fs_log_append(FS_LOG_CLONE, 0, dst, 0, src, fs_log_strlen(src) + 1);
+}
+
+// Write the tree to the image not in use and point the log at it
+// Returns VFS_OK, or a negative VFS error code
+int fs_log_checkpoint() {
+    if (!fs_log_active) {
+        return VFS_ERR_INVALID;
+    }
+
+    // The snapshot flushes the page cache; those writes are in the image
+    vic_uint32 slot = 1 - fs_log_slot;
+    fs_log_active = false;
+    int result = fs_snapshot(fs_log_images[slot]);
+
+    FSLogHeader header;
+    if (result >= 0) {
+        result = fs_snapshot_checksum(fs_log_images[slot], &header.base);
+    }
+    if (result >= 0) {
+        fs_log_copy(header.magic, FS_LOG_MAGIC, 8);
+        header.version = FS_LOG_VERSION;
+        header.generation = fs_log_generation + 1;
+
+        // Overwrite the header only; until it lands the old image and
+        // log still describe the tree
+        int fd = vfs_open(fs_log_path, VFS_O_WRITE | VFS_O_CREATE);
+        if (fd < 0) {
+            result = fd;
+        } else {
+            result = vfs_write(fd, &header, sizeof(header));
+            if (result >= 0) {
+                result = vfs_fsync(fd);
+            }
+            int closed = vfs_close(fd);
+            if (result >= 0) {
+                result = closed;
+            }
+        }
+    }
+
+    fs_log_active = true;
+    if (result < 0) {
+        // Changes flushed during the attempt were not logged
+        fs_log_overflow = true;
+        return result;
+    }
+
+    fs_log_slot = slot;
+    fs_log_generation = header.generation;
+    fs_log_used = 0;
+    fs_log_committed = sizeof(header);
+    fs_log_overflow = false;
+    return VFS_OK;
+}
+
+// Group commit: append every queued record to the log in one write
+// Returns VFS_OK, or a negative VFS error code
+int fs_log_commit() {
+    if (!fs_log_active || fs_log_committing) {
+        return VFS_OK;
+    }
+    if (fs_log_overflow) {
+        return fs_log_checkpoint();
+    }
+    if (fs_log_used == 0) {
+        return VFS_OK;
+    }
+
+    // Close the batch; fs_log_append always leaves room for this record
+    fs_log_append(FS_LOG_COMMIT, 0, "", 0, nullptr, 0);
+
+    fs_log_committing = true;
+    vic_uint32 batch = fs_log_used;
+
+    int fd = vfs_open(fs_log_path, VFS_O_WRITE);
+    int result = fd;
+    if (fd >= 0) {
+        result = vfs_seek(fd, fs_log_committed);
+        if (result >= 0) {
+            result = vfs_write(fd, fs_log_buffer, batch);
+            if (result >= 0 && (vic_uint32)result != batch) {
+                result = VFS_ERR_NO_SPACE;
+            }
+        }
+        if (result >= 0) {
+            result = vfs_fsync(fd);
+        }
+        int closed = vfs_close(fd);
+        if (result >= 0) {
+            result = closed;
+        }
+    }
+
+    if (result >= 0) {
+        // Keep records queued by writeback during the commit
+        fs_log_copy(fs_log_buffer, fs_log_buffer + batch, fs_log_used - batch);
+        fs_log_used -= batch;
+        fs_log_committed += batch;
+    } else {
+        // Reopen the batch: the retry rewrites it, with whatever arrives
+        // meanwhile, at the same offset. Whether or not the failed write
+        // or fsync reached the disk, the records then appear only once.
+        vic_uint32 commit = batch - sizeof(FSLogRecord);
+        fs_log_copy(fs_log_buffer + commit, fs_log_buffer + batch, fs_log_used - batch);
+        fs_log_used -= sizeof(FSLogRecord);
+    }
+    fs_log_committing = false;
+
+    if (result < 0) {
+        return result;
+    }
+    if (fs_log_overflow || fs_log_committed > FS_LOG_CHECKPOINT_SIZE) {
+        return fs_log_checkpoint();
+    }
+    return VFS_OK;
+}
+
+// Apply one replayed record to the RAM filesystem
+static void fs_log_apply(const FSLogRecord* record, const char* path) {
+    if (record->op == FS_LOG_CREATE) {
+        fs_create_node(path, record->type);
+        return;
+    }
+
+    int index = fs_find_node(path);
+    if (index < 0) {
+        return;
+    }
+    if (record->op == FS_LOG_WRITE) {
+        fs_write(index, record->offset, fs_log_data, record->len);
+    } else if (record->op == FS_LOG_TRUNCATE) {
+        fs_truncate(index, record->offset);
+    } else if (record->op == FS_LOG_REMOVE) {
+        fs_remove_node(index);
+    } else if (record->op == FS_LOG_CLONE && record->len > 0) {
+        fs_log_data[record->len - 1] = '\0';
+        int src = fs_find_node(fs_log_data);
+        if (src >= 0) {
+            fs_clone(src, index);
+        }
+    }
+}
+
+// Read and check the next record of a generation, leaving its data in
+// fs_log_data
+// Returns false at the end of the log or at a torn, corrupt or stale record
+static bool fs_log_read_record(int fd, vic_uint32 generation, FSLogRecord* record, char* path) {
+    if (vfs_read(fd, record, sizeof(*record)) != (int)sizeof(*record) ||
+        record->path_len >= VFS_MAX_PATH || record->len > FS_LOG_CHUNK ||
+        vfs_read(fd, path, record->path_len) != record->path_len ||
+        vfs_read(fd, fs_log_data, record->len) != (int)record->len) {
+        return false;
+    }
+    path[record->path_len] = '\0';
+
+    vic_uint32 expected = record->checksum;
+    record->checksum = 0;
+    vic_uint32 crc = fs_crc32(0xFFFFFFFF, &generation, sizeof(generation));
+    crc = fs_crc32(crc, record, sizeof(*record));
+    crc = fs_crc32(crc, path, record->path_len);
+    crc = fs_crc32(crc, fs_log_data, record->len);
+    return ~crc == expected;
+}
+
+// Read the log header
+// Returns false if there is no log or it is not one
+static bool fs_log_read_header(FSLogHeader* header) {
+    int fd = vfs_open(fs_log_path, VFS_O_READ);
+    if (fd < 0) {
+        return false;
+    }
+    bool valid = vfs_read(fd, header, sizeof(*header)) == (int)sizeof(*header) &&
+                 header->version == FS_LOG_VERSION;
+    for (int i = 0; i < 8 && valid; i++) {
+        valid = (header->magic[i] == FS_LOG_MAGIC[i]);
+    }
+    vfs_close(fd);
+    return valid;
+}
+
+// Replay the log of a generation over the restored image
+// Only batches closed by a commit record are applied, so a torn final
+// batch is dropped whole
+// Returns the number of records applied
+static int fs_log_replay(vic_uint32 generation) {
+    int fd = vfs_open(fs_log_path, VFS_O_READ);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int count = 0;
+    vic_uint32 batch_start = sizeof(FSLogHeader);
+    vic_uint32 pos = batch_start;
+    vfs_seek(fd, batch_start);
+    FSLogRecord record;
+    char path[VFS_MAX_PATH];
+
+    while (fs_log_read_record(fd, generation, &record, path)) {
+        pos += sizeof(record) + record.path_len + record.len;
+        if (record.op != FS_LOG_COMMIT) {
+            continue;
+        }
+
+        // The batch is complete: go back and apply it
+        vfs_seek(fd, batch_start);
+        while (fs_log_read_record(fd, generation, &record, path) && record.op != FS_LOG_COMMIT) {
+            fs_log_apply(&record, path);
+            count++;
+        }
+        batch_start = pos;
+    }
+
+    vfs_close(fd);
+    return count;
+}
+
+// Start logging the RAM filesystem to log_path, checkpointing into
+// image_path and its alternate. The image the log is based on is restored
+// and the log replayed first.
+// Returns the number of replayed records, or a negative VFS error code
+int fs_log_attach(const char* log_path, const char* image_path) {
+    if (fs_log_active) {
+        return VFS_ERR_BUSY;
+    }
+    vic_uint32 image_len = fs_log_strlen(image_path);
+    if (fs_log_strlen(log_path) >= VFS_MAX_PATH ||
+        image_len + sizeof(FS_LOG_ALT_SUFFIX) > VFS_MAX_PATH) {
+        return VFS_ERR_INVALID;
+    }
+    fs_log_copy(fs_log_path, log_path, fs_log_strlen(log_path) + 1);
+    fs_log_copy(fs_log_images[0], image_path, image_len + 1);
+    fs_log_copy(fs_log_images[1], image_path, image_len);
+    fs_log_copy(fs_log_images[1] + image_len, FS_LOG_ALT_SUFFIX, sizeof(FS_LOG_ALT_SUFFIX));
+
+    // Restore the image the log names; without a usable log, whichever
+    // image is intact, the primary first
+    FSLogHeader header;
+    bool have_log = fs_log_read_header(&header);
+    int slot = -1;
+    bool matched = false;
+    for (int i = 0; i < 2 && !matched; i++) {
+        vic_uint32 base;
+        if (fs_snapshot_checksum(fs_log_images[i], &base) < 0) {
+            continue;
+        }
+        if (have_log && base == header.base) {
+            slot = i;
+            matched = true;
+        } else if (slot < 0) {
+            slot = i;
+        }
+    }
+
+    int replayed = 0;
+    if (slot >= 0) {
+        int result = fs_restore(fs_log_images[slot]);
+        if (result < 0) {
+            return result;
+        }
+        if (matched) {
+            replayed = fs_log_replay(header.generation);
+        }
+
+        // Replay changed the tree behind the VFS's back
+        vfs_drop_cache("/");
+        if (vfs_chdir(vfs_getcwd()) < 0) {
+            vfs_chdir("/");
+        }
+    }
+    fs_log_slot = (slot >= 0) ? slot : 1;
+    fs_log_generation = have_log ? header.generation : 0;
+
+    // Fold the replayed records into a fresh image and empty log
+    fs_log_active = true;
+    fs_log_used = 0;
+    fs_log_overflow = false;
+    int result = fs_log_checkpoint();
+    if (result < 0) {
+        fs_log_active = false;
+        return result;
+    }
+    return replayed;
+}
+
+// Commit outstanding records and stop logging
+int fs_log_detach() {
+    int result = fs_log_commit();
+    fs_log_active = false;
+    fs_log_used = 0;
+    return result;
+}
+
+// Check whether changes are being logged
+bool fs_log_is_active() {
+    return fs_log_active;
+}
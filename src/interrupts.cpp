@@ -0,0 +1,337 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "interrupts.h"
+
+// Forward declarations from kernel.cpp
+void kprint(const char* str);
+
+// Forward declaration from sched.cpp
+void sched_irq_exit();
+
+// Forward declarations from apic.cpp
+bool apic_init(vic_uint8 vector_base, vic_uint8 spurious_vector);
+void apic_set_mask(vic_uint8 irq, bool masked);
+void apic_eoi();
+
+// IO port functions
+static inline void outb(vic_uint16 port, vic_uint8 val) {
+    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline vic_uint8 inb(vic_uint16 port) {
+    vic_uint8 ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Segment selectors of the kernel GDT
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+
+// Present, ring 0, 32-bit interrupt gate (IF cleared on entry)
+#define IDT_INTERRUPT_GATE 0x8E
+
+#define IDT_ENTRIES 256
+#define EXCEPTION_COUNT 32
+
+// 8259 PIC ports and commands
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA 0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_ICW1_INIT 0x11      // Edge triggered, cascade, ICW4 follows
+#define PIC_ICW4_8086 0x01
+#define PIC_READ_ISR 0x0B
+#define PIC_CASCADE_IRQ 2
+
+// What the CPU pushes for an interrupt taken in ring 0
+struct InterruptFrame {
+    vic_uint32 eip;
+    vic_uint32 cs;
+    vic_uint32 eflags;
+};
+
+struct IdtEntry {
+    vic_uint16 offset_low;
+    vic_uint16 selector;
+    vic_uint8 zero;
+    vic_uint8 type_attr;
+    vic_uint16 offset_high;
+} __attribute__((packed));
+
+struct DescriptorPointer {
+    vic_uint16 limit;
+    vic_uint32 base;
+} __attribute__((packed));
+
+// Flat 4 GiB code and data segments. The bootloader's GDT may be gone by
+// now, so the kernel brings its own before taking any interrupt.
+static const vic_uint64 gdt[3] = {
+    0,
+    0x00CF9A000000FFFFull,      // Kernel code
+    0x00CF92000000FFFFull       // Kernel data
+};
+
+static IdtEntry idt[IDT_ENTRIES];
+
+IrqHandler irq_handlers[IRQ_COUNT];
+vic_uint32 irq_counts[IRQ_COUNT];
+bool interrupts_apic = false;
+
+// Every line masked except the cascade to the second PIC
+vic_uint16 pic_mask = 0xFFFF & ~(1u << PIC_CASCADE_IRQ);
+
+static const char* const exception_names[EXCEPTION_COUNT] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow",
+    "bound range exceeded", "invalid opcode", "device not available",
+    "double fault", "coprocessor segment overrun", "invalid TSS",
+    "segment not present", "stack fault", "general protection fault",
+    "page fault", "reserved", "x87 floating point", "alignment check",
+    "machine check", "SIMD floating point", "virtualization",
+    "control protection", "reserved", "reserved", "reserved", "reserved",
+    "reserved", "reserved", "hypervisor injection", "VMM communication",
+    "security", "reserved"
+};
+
+static void interrupts_print_hex(vic_uint32 value) {
+    char out[11];
+    out[0] = '0';
+    out[1] = 'x';
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = "0123456789ABCDEF"[(value >> (28 - i * 4)) & 0xF];
+    }
+    out[10] = '\0';
+    kprint(out);
+}
+
+// Report a CPU exception and stop; none of them is recoverable yet
+static void exception_handler(vic_uint32 vector, InterruptFrame* frame, vic_uint32 error) {
+    kprint("\nKernel exception ");
+    interrupts_print_hex(vector);
+    kprint(" (");
+    kprint(exception_names[vector]);
+    kprint(") at EIP ");
+    interrupts_print_hex(frame->eip);
+    kprint(", error ");
+    interrupts_print_hex(error);
+    if (vector == 14) {
+        vic_uint32 cr2;
+        asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+        kprint(", address ");
+        interrupts_print_hex(cr2);
+    }
+    kprint("\nSystem halted.\n");
+
+    for (;;) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+static void irq_send_eoi(vic_uint8 irq) {
+    if (interrupts_apic) {
+        apic_eoi();
+        return;
+    }
+    if (irq >= 8) {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+static void irq_dispatch(vic_uint8 irq) {
+    // The 8259 raises IRQ 7/15 for requests that went away; those are not
+    // in service and take no EOI (beyond the cascade for IRQ 15)
+    if (!interrupts_apic && (irq == 7 || irq == 15)) {
+        vic_uint16 port = (irq == 7) ? PIC1_COMMAND : PIC2_COMMAND;
+        outb(port, PIC_READ_ISR);
+        if (!(inb(port) & 0x80)) {
+            if (irq == 15) {
+                outb(PIC1_COMMAND, PIC_EOI);
+            }
+            return;
+        }
+    }
+
+    irq_counts[irq]++;
+    if (irq_handlers[irq]) {
+        irq_handlers[irq]();
+    }
+    irq_send_eoi(irq);
+
+    // Switch threads only once the controller can deliver again
+    sched_irq_exit();
+}
+
+// Entry points. The interrupt attribute makes the compiler save every
+// register it touches and return with iret.
+constexpr bool exception_has_error(int vector) {
+    return vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 ||
+           vector == 21 || vector == 29 || vector == 30;
+}
+
+template <int N>
+__attribute__((interrupt)) static void exception_stub(InterruptFrame* frame) {
+    exception_handler(N, frame, 0);
+}
+
+template <int N>
+__attribute__((interrupt)) static void exception_stub_error(InterruptFrame* frame, vic_uint32 error) {
+    exception_handler(N, frame, error);
+}
+
+template <int N>
+__attribute__((interrupt)) static void irq_stub(InterruptFrame* /* frame */) {
+    irq_dispatch(N);
+}
+
+// Local APIC spurious interrupts need no EOI
+__attribute__((interrupt)) static void spurious_stub(InterruptFrame* /* frame */) {
+}
+
+static void idt_set_gate(int vector, void* entry) {
+    vic_uint32 offset = (vic_uint32)(vic_uintptr)entry;
+    idt[vector].offset_low = offset & 0xFFFF;
+    idt[vector].selector = GDT_KERNEL_CODE;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_INTERRUPT_GATE;
+    idt[vector].offset_high = offset >> 16;
+}
+
+template <int N>
+static void idt_fill_exceptions() {
+    if constexpr (N < EXCEPTION_COUNT) {
+        if constexpr (exception_has_error(N)) {
+            idt_set_gate(N, (void*)exception_stub_error<N>);
+        } else {
+            idt_set_gate(N, (void*)exception_stub<N>);
+        }
+        idt_fill_exceptions<N + 1>();
+    }
+}
+
+template <int N>
+static void idt_fill_irqs() {
+    if constexpr (N < IRQ_COUNT) {
+        idt_set_gate(IRQ_BASE_VECTOR + N, (void*)irq_stub<N>);
+        idt_fill_irqs<N + 1>();
+    }
+}
+
+static void gdt_load() {
+    DescriptorPointer pointer = { sizeof(gdt) - 1, (vic_uint32)(vic_uintptr)gdt };
+    asm volatile ("lgdt %0\n\t"
+                  "ljmp %1, $1f\n"
+                  "1:\n\t"
+                  "mov %2, %%ax\n\t"
+                  "mov %%ax, %%ds\n\t"
+                  "mov %%ax, %%es\n\t"
+                  "mov %%ax, %%fs\n\t"
+                  "mov %%ax, %%gs\n\t"
+                  "mov %%ax, %%ss"
+                  : : "m"(pointer), "i"(GDT_KERNEL_CODE), "i"(GDT_KERNEL_DATA)
+                  : "eax", "memory");
+}
+
+static void pic_apply_mask() {
+    outb(PIC1_DATA, pic_mask & 0xFF);
+    outb(PIC2_DATA, pic_mask >> 8);
+}
+
+// Move the PICs off the exception vectors onto IRQ_BASE_VECTOR
+static void pic_remap() {
+    outb(PIC1_COMMAND, PIC_ICW1_INIT);
+    outb(PIC2_COMMAND, PIC_ICW1_INIT);
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    outb(PIC1_DATA, 1u << PIC_CASCADE_IRQ);     // Slave on IRQ 2
+    outb(PIC2_DATA, PIC_CASCADE_IRQ);           // Slave identity
+    outb(PIC1_DATA, PIC_ICW4_8086);
+    outb(PIC2_DATA, PIC_ICW4_8086);
+    pic_apply_mask();
+}
+
+static void irq_set_mask(vic_uint8 irq, bool masked) {
+    if (interrupts_apic) {
+        apic_set_mask(irq, masked);
+        return;
+    }
+
+    if (masked) {
+        pic_mask |= 1u << irq;
+    } else {
+        pic_mask &= ~(1u << irq);
+    }
+    pic_apply_mask();
+}
+
+void interrupts_init() {
+    gdt_load();
+
+    idt_fill_exceptions<0>();
+    idt_fill_irqs<0>();
+    idt_set_gate(IRQ_SPURIOUS_VECTOR, (void*)spurious_stub);
+
+    DescriptorPointer pointer = { sizeof(idt) - 1, (vic_uint32)(vic_uintptr)idt };
+    asm volatile ("lidt %0" : : "m"(pointer));
+
+    // The PICs are remapped either way so a stray 8259 interrupt cannot
+    // land on an exception vector
+    pic_remap();
+    if (apic_init(IRQ_BASE_VECTOR, IRQ_SPURIOUS_VECTOR)) {
+        pic_mask = 0xFFFF;
+        pic_apply_mask();
+        interrupts_apic = true;
+        kprint("Interrupts: IO-APIC\n");
+    } else {
+        kprint("Interrupts: 8259 PIC\n");
+    }
+}
+
+void interrupts_enable() {
+    asm volatile ("sti" : : : "memory");
+}
+
+void interrupts_disable() {
+    asm volatile ("cli" : : : "memory");
+}
+
+bool interrupts_save() {
+    vic_uint32 flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags & (1u << 9);
+}
+
+void interrupts_restore(bool enabled) {
+    if (enabled) {
+        asm volatile ("sti" : : : "memory");
+    }
+}
+
+int irq_register(vic_uint8 irq, IrqHandler handler) {
+    if (irq >= IRQ_COUNT || !handler || irq_handlers[irq]) {
+        return -1;
+    }
+
+    irq_handlers[irq] = handler;
+    irq_set_mask(irq, false);
+    return 0;
+}
+
+void irq_unregister(vic_uint8 irq) {
+    if (irq >= IRQ_COUNT) {
+        return;
+    }
+
+    irq_set_mask(irq, true);
+    irq_handlers[irq] = nullptr;
+}
+
+vic_uint32 irq_count(vic_uint8 irq) {
+    return (irq < IRQ_COUNT) ? irq_counts[irq] : 0;
+}
+
+bool interrupts_using_apic() {
+    return interrupts_apic;
+}
@@ -0,0 +1,49 @@
+// src/interrupts.h
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// ISA IRQ n is delivered on vector IRQ_BASE_VECTOR + n
+#define IRQ_BASE_VECTOR 0x20
+#define IRQ_COUNT 16
+
+// Local APIC spurious interrupts
+#define IRQ_SPURIOUS_VECTOR 0xFF
+
+// ISA IRQ lines
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_ATA_PRIMARY 14
+#define IRQ_ATA_SECONDARY 15
+
+// Runs in interrupt context with interrupts disabled; EOI is sent after
+// it returns
+typedef void (*IrqHandler)();
+
+// Load the GDT and IDT and set up the interrupt controllers: IO-APIC and
+// local APIC when ACPI describes them, the remapped 8259 PICs otherwise.
+// Every IRQ starts masked and interrupts stay disabled.
+void interrupts_init();
+
+void interrupts_enable();
+void interrupts_disable();
+
+// Disable interrupts and return whether they were on, for a critical
+// section that may already run with them off
+bool interrupts_save();
+void interrupts_restore(bool enabled);
+
+// Install the handler of an IRQ line and unmask it
+// Returns 0 on success, -1 for a bad line or one already taken
+int irq_register(vic_uint8 irq, IrqHandler handler);
+void irq_unregister(vic_uint8 irq);
+
+// Interrupts taken on a line since boot
+vic_uint32 irq_count(vic_uint8 irq);
+
+bool interrupts_using_apic();
+
+#endif // INTERRUPTS_H
@@ -1,15 +1,38 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "multiboot.h"
+#include "pmm.h"
+#include "paging.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "sched.h"
 
 // Forward declaration of VShell handler
 void vshell_init();
 void vshell_execute_command(const char* command);
 
+// Forward declaration from meminfo.cpp
+void meminfo_init();
+
+// Forward declarations from keyboard.cpp
+bool keyboard_has_key();
+vic_uint8 keyboard_get_scancode();
+void keyboard_enable_irq();
+void keyboard_wait();
+
+// Forward declaration from vfs.cpp
+void vfs_start_writeback();
+
 // VGA buffer address
 volatile vic_uint16* const VGA_MEMORY = (vic_uint16*)0xB8000;
 const vic_uint8 VGA_WIDTH = 80;
 const vic_uint8 VGA_HEIGHT = 25;
+
+// Copy of the text screen in ordinary memory. VGA memory is mapped
+// write-combining, so it is only ever written; scrolling reads the copy.
+vic_uint16 vga_shadow[VGA_WIDTH * VGA_HEIGHT];
+
 vic_uint8 cursor_x = 0;
 vic_uint8 cursor_y = 0;
 
@@ -22,16 +45,6 @@ static inline void outb(vic_uint16 port, vic_uint8 val) {
     asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
 }
 
-static inline vic_uint8 inb(vic_uint16 port) {
-    vic_uint8 ret;
-    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-
-// PS/2 keyboard ports
-#define KEYBOARD_DATA_PORT 0x60
-#define KEYBOARD_STATUS_PORT 0x64
-
 // Keyboard scan codes for special keys
 #define SC_ENTER 0x1C
 #define SC_BACKSPACE 0x0E
@@ -91,6 +104,12 @@ void update_cursor() {
     outb(0x3D5, (vic_uint8)((position >> 8) & 0xFF));
 }
 
+// Write one character cell to the screen and its copy
+static inline void vga_put(int position, vic_uint16 value) {
+    vga_shadow[position] = value;
+    VGA_MEMORY[position] = value;
+}
+
 // Clear the screen - now exported with extern "C"
 extern "C" void clear_screen() {
     // Black background, white text (blank)
@@ -98,7 +117,7 @@ extern "C" void clear_screen() {
 
     // Fill entire screen with blank characters
     for(int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-        VGA_MEMORY[i] = blank;
+        vga_put(i, blank);
     }
 
     // Reset cursor position
@@ -116,13 +135,13 @@ void new_line() {
         // Simple scrolling - move everything up one line
         for (int y = 0; y < VGA_HEIGHT - 1; y++) {
             for (int x = 0; x < VGA_WIDTH; x++) {
-                VGA_MEMORY[y * VGA_WIDTH + x] = VGA_MEMORY[(y + 1) * VGA_WIDTH + x];
+                vga_put(y * VGA_WIDTH + x, vga_shadow[(y + 1) * VGA_WIDTH + x]);
             }
         }
 
         // Clear the last line
         for (int x = 0; x < VGA_WIDTH; x++) {
-            VGA_MEMORY[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = 0x0F00;
+            vga_put((VGA_HEIGHT - 1) * VGA_WIDTH + x, 0x0F00);
         }
 
         cursor_y = VGA_HEIGHT - 1;
@@ -143,7 +162,7 @@ void kputchar(char c) {
         if (cursor_x > 0) {
             cursor_x--;
             const unsigned int position = cursor_y * VGA_WIDTH + cursor_x;
-            VGA_MEMORY[position] = 0x0F00;  // White on black space
+            vga_put(position, 0x0F00);  // White on black space
             update_cursor();
         }
         return;
@@ -153,7 +172,7 @@ void kputchar(char c) {
     const unsigned int position = cursor_y * VGA_WIDTH + cursor_x;
 
     // Write character with white on black
-    VGA_MEMORY[position] = (vic_uint16)c | 0x0F00;
+    vga_put(position, (vic_uint16)c | 0x0F00);
 
     // Move cursor
     cursor_x++;
@@ -216,7 +235,7 @@ void update_command_line() {
     // Clear the current line
     for (int i = cursor_x; i < VGA_WIDTH; i++) {
         const unsigned int position = cursor_y * VGA_WIDTH + i;
-        VGA_MEMORY[position] = 0x0F00;  // White on black space
+        vga_put(position, 0x0F00);  // White on black space
     }
 
     // Display the command buffer
@@ -270,23 +289,19 @@ void handle_arrow_right() {
 
 // Initialize keyboard
 void init_keyboard() {
-    // Basic initialization - more comprehensive would be needed for a real OS
+    // Keys arrive on IRQ 1 and queue up until the main loop takes them
+    keyboard_enable_irq();
     keyboard_initialized = true;
 }
 
-// Check if keyboard has input
-bool keyboard_has_input() {
-    return (inb(KEYBOARD_STATUS_PORT) & 1);
-}
-
 // Process keyboard input
 void process_keypress() {
-    if (!keyboard_has_input()) {
+    if (!keyboard_has_key()) {
         return;
     }
 
     // Read scan code
-    vic_uint8 scancode = inb(KEYBOARD_DATA_PORT);
+    vic_uint8 scancode = keyboard_get_scancode();
 
     // Handle extended keys (E0 prefix)
     if (scancode == 0xE0) {
@@ -416,33 +431,48 @@ void process_keypress() {
     }
 }
 
-// Simple delay function
-void delay(int count) {
-    for (int i = 0; i < count; i++) {
-        asm volatile("nop");
-    }
-}
-
 // Kernel entry point
-extern "C" void kernel_main() {
+extern "C" void kernel_main(vic_uint32 multiboot_magic, const MultibootInfo* multiboot_info) {
+    // Mark the unused boot stack so meminfo can report its peak
+    meminfo_init();
+
     // Clear the screen
     clear_screen();
 
+    // Build the physical page allocator from the boot memory map
+    pmm_init(multiboot_magic, multiboot_info);
+
+    // Identity map memory; VGA text output becomes write-combining
+    paging_init();
+
+    // IDT and interrupt controllers; every IRQ starts masked
+    interrupts_init();
+    timer_init();
+
+    // From here on this is the main thread; idle and others run beside it
+    sched_init();
+
     // Initialize keyboard
     init_keyboard();
+    interrupts_enable();
 
     // Initialize VShell
     vshell_init();
 
+    // Dirty file data now reaches the disk in the background
+    vfs_start_writeback();
+
     // Display initial prompt
     display_prompt();
 
     // Main loop
     while(1) {
         // Process any keyboard input
-        process_keypress();
+        while (keyboard_has_key()) {
+            process_keypress();
+        }
 
-        // Small delay to reduce CPU usage
-        delay(1000);
+        // Block until a key arrives; other threads run meanwhile
+        keyboard_wait();
     }
 }
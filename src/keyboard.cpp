@@ -1,6 +1,9 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "interrupts.h"
+#include "timer.h"
+#include "sched.h"
 
 // Forward declarations
 void kputchar(char c);
@@ -35,11 +38,71 @@ static bool shift_pressed = false;
 static bool caps_lock_on = false;
 static bool last_was_e0 = false;
 
+// Scancodes queued by the IRQ 1 handler; head only moves in the handler,
+// tail only outside it
+#define KEYBOARD_QUEUE_SIZE 64
+static volatile vic_uint8 keyboard_queue[KEYBOARD_QUEUE_SIZE];
+static volatile vic_uint32 keyboard_head = 0;
+static volatile vic_uint32 keyboard_tail = 0;
+static bool keyboard_irq_enabled = false;
+
+// Threads waiting in keyboard_wait
+static WaitQueue keyboard_waiters;
+
+static void keyboard_irq() {
+    vic_uint8 scancode = inb(KEYBOARD_DATA_PORT);
+
+    // Drop keys when the queue is full rather than overwrite older ones
+    if (keyboard_head - keyboard_tail < KEYBOARD_QUEUE_SIZE) {
+        keyboard_queue[keyboard_head % KEYBOARD_QUEUE_SIZE] = scancode;
+        keyboard_head++;
+    }
+    sched_wake(&keyboard_waiters);
+}
+
 // Checks if the keyboard has a key available
 bool keyboard_has_key() {
+    if (keyboard_irq_enabled) {
+        return keyboard_head != keyboard_tail;
+    }
     return (inb(KEYBOARD_STATUS_PORT) & 1);
 }
 
+// Next scancode; only call when keyboard_has_key() is true
+vic_uint8 keyboard_get_scancode() {
+    if (!keyboard_irq_enabled) {
+        return inb(KEYBOARD_DATA_PORT);
+    }
+
+    vic_uint8 scancode = keyboard_queue[keyboard_tail % KEYBOARD_QUEUE_SIZE];
+    keyboard_tail++;
+    return scancode;
+}
+
+// Sleep until a key is available
+void keyboard_wait() {
+    while (!keyboard_has_key()) {
+        if (keyboard_irq_enabled && sched_running()) {
+            sched_wait(&keyboard_waiters, keyboard_has_key);
+        } else if (keyboard_irq_enabled) {
+            timer_idle(keyboard_has_key);
+        } else {
+            // Small delay to reduce CPU usage
+            for (int i = 0; i < 1000; i++) {
+                asm volatile("nop");
+            }
+        }
+    }
+}
+
+// Take keys from IRQ 1 instead of polling the controller
+void keyboard_enable_irq() {
+    while (inb(KEYBOARD_STATUS_PORT) & 1) {
+        inb(KEYBOARD_DATA_PORT);
+    }
+    keyboard_irq_enabled = (irq_register(IRQ_KEYBOARD, keyboard_irq) == 0);
+}
+
 // Waits for a keypress and returns the ASCII character
 extern "C" char keyboard_read_char() {
     vic_uint8 scancode;
@@ -48,15 +111,10 @@ extern "C" char keyboard_read_char() {
     // Wait for a key to be pressed
     while (!c) {
         // Wait until a key is available
-        while (!keyboard_has_key()) {
-            // Small delay to reduce CPU usage
-            for (int i = 0; i < 1000; i++) {
-                asm volatile("nop");
-            }
-        }
+        keyboard_wait();
 
         // Read the scan code
-        scancode = inb(KEYBOARD_DATA_PORT);
+        scancode = keyboard_get_scancode();
 
         // Handle extended keys
         if (scancode == 0xE0) {
@@ -143,6 +201,6 @@ void keyboard_init() {
 
     // Flush the keyboard buffer
     while (keyboard_has_key()) {
-        inb(KEYBOARD_DATA_PORT);
+        keyboard_get_scancode();
     }
 }
@@ -0,0 +1,335 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "kheap.h"
+#include "pmm.h"
+#include "interrupts.h"
+
+// First word of every heap page, telling kfree what the page holds
+#define KHEAP_SLAB_MAGIC  0x534C4142   // "SLAB"
+#define KHEAP_LARGE_MAGIC 0x4C415247   // "LARG"
+
+// kmalloc size classes: 16, 32, ... KHEAP_MAX_SMALL
+#define KHEAP_MIN_SHIFT 4
+#define KHEAP_CLASSES 7
+
+// Header at the start of every slab page
+struct KmemSlab {
+    vic_uint32 magic;
+    KmemCache* cache;
+    void* free;              // Free objects, linked through their first word
+    vic_uint32 in_use;
+    KmemSlab* next;          // Partial list
+    KmemSlab* prev;
+};
+
+// Header in front of a large allocation
+struct KheapLarge {
+    vic_uint32 magic;
+    vic_uint32 order;
+    vic_uint32 size;
+    vic_uint32 reserved;
+};
+
+// Objects start after the slab header, 8-byte aligned
+#define KHEAP_SLAB_OFFSET ((sizeof(KmemSlab) + 7) & ~7u)
+
+KmemCache kheap_caches[KHEAP_MAX_CACHES];
+int kheap_cache_count = 0;
+
+KheapStats kheap_stats;
+
+// kmalloc size classes, set up on first use
+KmemCache* kheap_classes[KHEAP_CLASSES];
+bool kheap_ready = false;
+
+static KmemSlab* kheap_slab_of(void* ptr) {
+    return (KmemSlab*)((vic_uintptr)ptr & ~(vic_uintptr)(PMM_PAGE_SIZE - 1));
+}
+
+static void kheap_partial_push(KmemCache* cache, KmemSlab* slab) {
+    slab->prev = nullptr;
+    slab->next = cache->partial;
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+static void kheap_partial_remove(KmemCache* cache, KmemSlab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = nullptr;
+    slab->prev = nullptr;
+}
+
+// Take a page for cache and thread its objects onto the free list
+static KmemSlab* kheap_slab_new(KmemCache* cache) {
+    vic_uint32 page = pmm_alloc_page();
+    if (page == 0) {
+        return nullptr;
+    }
+
+    KmemSlab* slab = (KmemSlab*)(vic_uintptr)page;
+    slab->magic = KHEAP_SLAB_MAGIC;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free = nullptr;
+
+    // Link back to front so objects are handed out in address order
+    vic_uint8* base = (vic_uint8*)slab + KHEAP_SLAB_OFFSET;
+    for (vic_uint32 i = cache->objects_per_slab; i > 0; i--) {
+        void** obj = (void**)(base + (i - 1) * cache->object_size);
+        *obj = slab->free;
+        slab->free = obj;
+    }
+
+    kheap_partial_push(cache, slab);
+    cache->slabs++;
+    cache->empty_slabs++;
+    return slab;
+}
+
+static KmemCache* kheap_cache_create(const char* name, vic_uint32 size) {
+    if (kheap_cache_count >= KHEAP_MAX_CACHES || size == 0 ||
+        size > PMM_PAGE_SIZE - KHEAP_SLAB_OFFSET) {
+        return nullptr;
+    }
+
+    KmemCache* cache = &kheap_caches[kheap_cache_count++];
+    int i = 0;
+    while (name[i] && i < KHEAP_CACHE_NAME - 1) {
+        cache->name[i] = name[i];
+        i++;
+    }
+    cache->name[i] = '\0';
+
+    // Room for the free list link, 8-byte aligned
+    cache->object_size = (size < 8) ? 8 : (size + 7) & ~7u;
+    cache->objects_per_slab = (PMM_PAGE_SIZE - KHEAP_SLAB_OFFSET) / cache->object_size;
+    cache->partial = nullptr;
+    cache->slabs = 0;
+    cache->empty_slabs = 0;
+    cache->objects_in_use = 0;
+    cache->peak_objects = 0;
+    return cache;
+}
+
+static void kheap_setup() {
+    static const char* const names[KHEAP_CLASSES] = {
+        "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+        "kmalloc-256", "kmalloc-512", "kmalloc-1024"
+    };
+
+    kheap_ready = true;
+    for (int i = 0; i < KHEAP_CLASSES; i++) {
+        kheap_classes[i] = kheap_cache_create(names[i], 1u << (KHEAP_MIN_SHIFT + i));
+    }
+}
+
+static void* kheap_cache_alloc(KmemCache* cache) {
+    if (!cache) {
+        return nullptr;
+    }
+
+    KmemSlab* slab = cache->partial;
+    if (!slab) {
+        slab = kheap_slab_new(cache);
+        if (!slab) {
+            return nullptr;
+        }
+    }
+
+    void** obj = (void**)slab->free;
+    slab->free = *obj;
+    if (slab->in_use == 0) {
+        cache->empty_slabs--;
+    }
+    slab->in_use++;
+    cache->objects_in_use++;
+    if (cache->objects_in_use > cache->peak_objects) {
+        cache->peak_objects = cache->objects_in_use;
+    }
+
+    if (slab->in_use == cache->objects_per_slab) {
+        kheap_partial_remove(cache, slab);
+    }
+    return obj;
+}
+
+static void kheap_cache_free(KmemCache* cache, void* obj) {
+    if (!cache || !obj) {
+        return;
+    }
+
+    KmemSlab* slab = kheap_slab_of(obj);
+    if (slab->magic != KHEAP_SLAB_MAGIC || slab->cache != cache) {
+        return;
+    }
+
+    // A full slab gets its first free object back
+    if (slab->in_use == cache->objects_per_slab) {
+        kheap_partial_push(cache, slab);
+    }
+
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    slab->in_use--;
+    cache->objects_in_use--;
+
+    if (slab->in_use == 0) {
+        cache->empty_slabs++;
+
+        // Keep one empty slab for the next allocation burst
+        if (cache->empty_slabs > 1) {
+            kheap_partial_remove(cache, slab);
+            slab->magic = 0;
+            pmm_free_page((vic_uint32)(vic_uintptr)slab);
+            cache->slabs--;
+            cache->empty_slabs--;
+        }
+    }
+}
+
+static void* kheap_alloc(vic_uint32 size) {
+    if (size <= KHEAP_MAX_SMALL) {
+        int cls = 0;
+        while ((1u << (KHEAP_MIN_SHIFT + cls)) < size) {
+            cls++;
+        }
+        return kheap_cache_alloc(kheap_classes[cls]);
+    }
+
+    // Large: whole pages with a header in front
+    if (size > (PMM_PAGE_SIZE << PMM_MAX_ORDER) - sizeof(KheapLarge)) {
+        return nullptr;
+    }
+    vic_uint32 order = pmm_order_for(size + sizeof(KheapLarge));
+    vic_uint32 addr = pmm_alloc_pages(order);
+    if (addr == 0) {
+        return nullptr;
+    }
+
+    KheapLarge* large = (KheapLarge*)(vic_uintptr)addr;
+    large->magic = KHEAP_LARGE_MAGIC;
+    large->order = order;
+    large->size = size;
+    large->reserved = 0;
+
+    kheap_stats.large_allocs++;
+    kheap_stats.large_pages += 1u << order;
+    if (kheap_stats.large_pages > kheap_stats.large_peak_pages) {
+        kheap_stats.large_peak_pages = kheap_stats.large_pages;
+    }
+    return large + 1;
+}
+
+static void kheap_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    KmemSlab* slab = kheap_slab_of(ptr);
+    if (slab->magic == KHEAP_SLAB_MAGIC) {
+        kheap_cache_free(slab->cache, ptr);
+        return;
+    }
+
+    KheapLarge* large = (KheapLarge*)slab;
+    if (large->magic == KHEAP_LARGE_MAGIC && ptr == large + 1) {
+        large->magic = 0;
+        kheap_stats.large_allocs--;
+        kheap_stats.large_pages -= 1u << large->order;
+        pmm_free_pages((vic_uint32)(vic_uintptr)large, large->order);
+    }
+}
+
+// Entry points. Threads are preempted from interrupts, so the heap is
+// only touched with them off.
+extern "C" KmemCache* kmem_cache_create(const char* name, vic_uint32 size) {
+    bool enabled = interrupts_save();
+    if (!kheap_ready) {
+        kheap_setup();
+    }
+    KmemCache* cache = kheap_cache_create(name, size);
+    interrupts_restore(enabled);
+    return cache;
+}
+
+extern "C" void* kmem_cache_alloc(KmemCache* cache) {
+    bool enabled = interrupts_save();
+    void* obj = kheap_cache_alloc(cache);
+    interrupts_restore(enabled);
+    return obj;
+}
+
+extern "C" void kmem_cache_free(KmemCache* cache, void* obj) {
+    bool enabled = interrupts_save();
+    kheap_cache_free(cache, obj);
+    interrupts_restore(enabled);
+}
+
+extern "C" void* kmalloc(vic_uint32 size) {
+    bool enabled = interrupts_save();
+    if (!kheap_ready) {
+        kheap_setup();
+    }
+    void* ptr = kheap_alloc(size);
+    interrupts_restore(enabled);
+    return ptr;
+}
+
+extern "C" void kfree(void* ptr) {
+    bool enabled = interrupts_save();
+    kheap_free(ptr);
+    interrupts_restore(enabled);
+}
+
+extern "C" int kmem_cache_count() {
+    return kheap_cache_count;
+}
+
+extern "C" const KmemCache* kmem_cache_get(int index) {
+    if (index < 0 || index >= kheap_cache_count) {
+        return nullptr;
+    }
+    return &kheap_caches[index];
+}
+
+extern "C" void kheap_get_stats(KheapStats* stats) {
+    *stats = kheap_stats;
+}
+
+// Global new/delete on the kernel heap. There are no exceptions, so a
+// failed allocation returns null; new is noexcept and the kernel builds
+// with -fcheck-new so new-expressions test for it before constructing.
+// Callers must still check the result.
+void* operator new(size_t size) noexcept {
+    return kmalloc((vic_uint32)size);
+}
+
+void* operator new[](size_t size) noexcept {
+    return kmalloc((vic_uint32)size);
+}
+
+void operator delete(void* ptr) noexcept {
+    kfree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    kfree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    kfree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    kfree(ptr);
+}
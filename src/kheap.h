@@ -0,0 +1,65 @@
+// src/kheap.h
+#ifndef KHEAP_H
+#define KHEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vstdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Slabs are single pages; objects bigger than this go to the page allocator
+#define KHEAP_MAX_SMALL 1024
+
+// Named caches, including the kmalloc size classes
+#define KHEAP_MAX_CACHES 16
+#define KHEAP_CACHE_NAME 16
+
+struct KmemSlab;
+
+// Cache of fixed-size objects carved out of one-page slabs. Slabs with
+// free objects sit on the partial list, so alloc and free are O(1); one
+// empty slab is kept per cache, further empty slabs go back to the page
+// allocator.
+typedef struct KmemCache {
+    char name[KHEAP_CACHE_NAME];
+    vic_uint32 object_size;
+    vic_uint32 objects_per_slab;
+    struct KmemSlab* partial;       // Slabs with at least one free object
+    vic_uint32 slabs;
+    vic_uint32 empty_slabs;
+    vic_uint32 objects_in_use;
+    vic_uint32 peak_objects;        // Most objects in use at once
+} KmemCache;
+
+// Allocations too big for a slab, served straight from the page allocator
+typedef struct KheapStats {
+    vic_uint32 large_allocs;
+    vic_uint32 large_pages;
+    vic_uint32 large_peak_pages;
+} KheapStats;
+
+// Create a cache for objects of size bytes (at most a slab's worth)
+// Returns null when the cache table is full or size is too big
+KmemCache* kmem_cache_create(const char* name, vic_uint32 size);
+void* kmem_cache_alloc(KmemCache* cache);
+void kmem_cache_free(KmemCache* cache, void* obj);
+
+// General allocations: power-of-two size classes from 16 to
+// KHEAP_MAX_SMALL bytes, page blocks above that
+// Returns null when out of memory
+void* kmalloc(vic_uint32 size);
+void kfree(void* ptr);
+
+// Cache table, for statistics
+int kmem_cache_count();
+const KmemCache* kmem_cache_get(int index);
+void kheap_get_stats(KheapStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KHEAP_H
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "pmm.h"
+#include "kheap.h"
+#include "arena.h"
+
+// Forward declarations from kernel.cpp
+void kprint(const char* str);
+
+// Forward declaration from vshellhandler.cpp
+void print_number(vic_uint32 value);
+
+// Shell scratch arena (vshellhandler.cpp)
+extern Arena vshell_arena;
+
+// Section and subsystem bounds (linker.ld)
+extern "C" char kernel_start[], kernel_end[];
+extern "C" char text_start[], text_end[];
+extern "C" char rodata_start[], rodata_end[];
+extern "C" char data_start[], data_end[];
+extern "C" char bss_start[], bss_end[];
+extern "C" char mem_stack_start[], mem_stack_end[];
+extern "C" char mem_ramfs_start[], mem_ramfs_end[];
+extern "C" char mem_fatfs_start[], mem_fatfs_end[];
+extern "C" char mem_cache_start[], mem_cache_end[];
+extern "C" char mem_editor_start[], mem_editor_end[];
+extern "C" char mem_shell_start[], mem_shell_end[];
+extern "C" char mem_mm_start[], mem_mm_end[];
+
+// Boot stack (boot.s)
+extern "C" char stack_bottom[], stack_top[];
+
+// Written over the unused stack at boot; the first word that changed
+// marks the deepest the stack has been
+#define MEMINFO_STACK_FILL 0x5A5AA5A5u
+
+// Room left below the live frame while filling
+#define MEMINFO_STACK_MARGIN 256
+
+struct MemInfoRegion {
+    const char* name;
+    const char* start;
+    const char* end;
+};
+
+static const MemInfoRegion meminfo_static[] = {
+    { "RAM filesystem ", mem_ramfs_start, mem_ramfs_end },
+    { "FatFs          ", mem_fatfs_start, mem_fatfs_end },
+    { "VFS/page cache ", mem_cache_start, mem_cache_end },
+    { "Editor         ", mem_editor_start, mem_editor_end },
+    { "Shell/console  ", mem_shell_start, mem_shell_end },
+    { "Memory manager ", mem_mm_start, mem_mm_end },
+};
+
+static vic_uint32 meminfo_span(const char* start, const char* end) {
+    return (vic_uint32)(end - start);
+}
+
+// Print bytes as KiB, rounded up
+static void meminfo_print_kib(vic_uint32 bytes) {
+    print_number((bytes + 1023) / 1024);
+    kprint(" KiB");
+}
+
+// Fill the unused part of the boot stack, called early from kernel_main
+void meminfo_init() {
+    vic_uint32 esp;
+    asm volatile ("mov %%esp, %0" : "=r"(esp));
+
+    vic_uint32* word = (vic_uint32*)stack_bottom;
+    vic_uint32* limit = (vic_uint32*)(vic_uintptr)(esp - MEMINFO_STACK_MARGIN);
+    while (word < limit) {
+        *word++ = MEMINFO_STACK_FILL;
+    }
+}
+
+// Deepest boot stack use so far, in bytes
+static vic_uint32 meminfo_stack_peak() {
+    const vic_uint32* word = (const vic_uint32*)stack_bottom;
+    const vic_uint32* top = (const vic_uint32*)stack_top;
+    while (word < top && *word == MEMINFO_STACK_FILL) {
+        word++;
+    }
+    return meminfo_span((const char*)word, stack_top);
+}
+
+static void meminfo_print_image() {
+    kprint("Kernel image: ");
+    meminfo_print_kib(meminfo_span(kernel_start, kernel_end));
+    kprint(" (text ");
+    meminfo_print_kib(meminfo_span(text_start, text_end));
+    kprint(", rodata ");
+    meminfo_print_kib(meminfo_span(rodata_start, rodata_end));
+    kprint(", data ");
+    meminfo_print_kib(meminfo_span(data_start, data_end));
+    kprint(", bss ");
+    meminfo_print_kib(meminfo_span(bss_start, bss_end));
+    kprint(")\n");
+
+    vic_uint32 grouped = 0;
+    for (vic_uint32 i = 0; i < sizeof(meminfo_static) / sizeof(meminfo_static[0]); i++) {
+        vic_uint32 bytes = meminfo_span(meminfo_static[i].start, meminfo_static[i].end);
+        grouped += bytes;
+        kprint("  ");
+        kprint(meminfo_static[i].name);
+        meminfo_print_kib(bytes);
+        kprint("\n");
+    }
+
+    vic_uint32 stack = meminfo_span(mem_stack_start, mem_stack_end);
+    kprint("  Boot stack     ");
+    meminfo_print_kib(stack);
+    kprint(" (peak ");
+    meminfo_print_kib(meminfo_stack_peak());
+    kprint(")\n");
+
+    kprint("  Other bss      ");
+    meminfo_print_kib(meminfo_span(bss_start, bss_end) - grouped - stack);
+    kprint("\n");
+}
+
+static void meminfo_print_pages() {
+    vic_uint32 total = pmm_total_pages();
+    if (total == 0) {
+        kprint("Physical memory: not managed\n");
+        return;
+    }
+
+    vic_uint32 free = pmm_free_page_count();
+    kprint("Physical memory: ");
+    meminfo_print_kib(total * PMM_PAGE_SIZE);
+    kprint(" usable, ");
+    meminfo_print_kib(free * PMM_PAGE_SIZE);
+    kprint(" free, peak used ");
+    meminfo_print_kib(pmm_peak_used_pages() * PMM_PAGE_SIZE);
+    kprint("\n");
+
+    // Free blocks per order, and how much free memory sits in blocks
+    // smaller than the largest order
+    kprint("  Free blocks by order:");
+    vic_uint32 largest = 0;
+    for (vic_uint32 order = 0; order <= PMM_MAX_ORDER; order++) {
+        vic_uint32 blocks = pmm_free_blocks(order);
+        kprint(" ");
+        print_number(blocks);
+        if (blocks > 0) {
+            largest = order;
+        }
+    }
+    kprint("\n");
+
+    vic_uint32 whole = pmm_free_blocks(PMM_MAX_ORDER) << PMM_MAX_ORDER;
+    kprint("  Largest free block ");
+    meminfo_print_kib(free ? (PMM_PAGE_SIZE << largest) : 0);
+    kprint(", fragmentation ");
+    print_number(free ? (free - whole) * 100 / free : 0);
+    kprint("%\n");
+}
+
+static void meminfo_print_heap() {
+    kprint("Heap caches (objects in use/peak, object size, slab pages):\n");
+    vic_uint32 slab_bytes = 0;
+    vic_uint32 used_bytes = 0;
+    for (int i = 0; i < kmem_cache_count(); i++) {
+        const KmemCache* cache = kmem_cache_get(i);
+        slab_bytes += cache->slabs * PMM_PAGE_SIZE;
+        used_bytes += cache->objects_in_use * cache->object_size;
+
+        // Size classes never used stay quiet
+        if (cache->peak_objects == 0) {
+            continue;
+        }
+        kprint("  ");
+        kprint(cache->name);
+        kprint(": ");
+        print_number(cache->objects_in_use);
+        kprint("/");
+        print_number(cache->peak_objects);
+        kprint(", ");
+        print_number(cache->object_size);
+        kprint(" B, ");
+        print_number(cache->slabs);
+        kprint("\n");
+    }
+
+    KheapStats stats;
+    kheap_get_stats(&stats);
+    kprint("  large: ");
+    print_number(stats.large_allocs);
+    kprint(" blocks, ");
+    meminfo_print_kib(stats.large_pages * PMM_PAGE_SIZE);
+    kprint(" (peak ");
+    meminfo_print_kib(stats.large_peak_pages * PMM_PAGE_SIZE);
+    kprint(")\n");
+
+    kprint("  Slab use ");
+    meminfo_print_kib(used_bytes);
+    kprint(" of ");
+    meminfo_print_kib(slab_bytes);
+    kprint(", waste ");
+    print_number(slab_bytes ? (slab_bytes - used_bytes) * 100 / slab_bytes : 0);
+    kprint("%\n");
+}
+
+// Process meminfo command
+void process_meminfo(const char* /* command */) {
+    meminfo_print_image();
+    meminfo_print_pages();
+    meminfo_print_heap();
+
+    kprint("Shell arena: peak ");
+    print_number(vshell_arena.peak);
+    kprint(" of ");
+    print_number(vshell_arena.size);
+    kprint(" bytes\n");
+}
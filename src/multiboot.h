@@ -0,0 +1,43 @@
+// src/multiboot.h
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// Value the bootloader leaves in eax
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// MultibootInfo flags
+#define MULTIBOOT_INFO_MEMORY  0x001   // mem_lower/mem_upper are valid
+#define MULTIBOOT_INFO_MEM_MAP 0x040   // mmap_addr/mmap_length are valid
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+// Boot information passed in ebx (Multiboot 0.6.96); only the fields up
+// to the memory map are used
+struct MultibootInfo {
+    vic_uint32 flags;
+    vic_uint32 mem_lower;     // KiB below 1 MiB
+    vic_uint32 mem_upper;     // KiB from 1 MiB to the first hole
+    vic_uint32 boot_device;
+    vic_uint32 cmdline;
+    vic_uint32 mods_count;
+    vic_uint32 mods_addr;
+    vic_uint32 syms[4];
+    vic_uint32 mmap_length;   // Bytes of memory map
+    vic_uint32 mmap_addr;
+} __attribute__((packed));
+
+// One BIOS memory map entry. size does not count itself, so the next
+// entry starts size + 4 bytes further on.
+struct MultibootMmapEntry {
+    vic_uint32 size;
+    vic_uint64 addr;
+    vic_uint64 len;
+    vic_uint32 type;
+} __attribute__((packed));
+
+#endif // MULTIBOOT_H
@@ -0,0 +1,413 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "page_cache.h"
+#include "pmm.h"
+#include "kheap.h"
+
+// Forward declarations from kernel.cpp
+void kprint(const char* str);
+
+// One cached page of file data
+struct CachePage {
+    bool used;
+    bool dirty;
+    bool referenced;        // CLOCK second-chance bit
+    VNode* node;
+    vic_uint32 index;       // Page index within the file
+    vic_uint32 valid;       // Bytes of data that belong to the file
+    vic_uint32 dirty_start; // Bytes changed since the last writeback; only
+    vic_uint32 dirty_end;   // these go back to the backend
+    int hash_next;          // Next page in the same bucket, -1 ends the chain
+    char* data;             // One page from the page allocator
+};
+
+// Page table and hash buckets (a power of two), allocated at init
+CachePage* cache_pages = nullptr;
+vic_uint32 cache_page_count = 0;
+int* cache_buckets;
+vic_uint32 cache_bucket_count = 0;
+
+// Scratch list of page slots for ordered writeback
+int* cache_order;
+
+// CLOCK hand
+vic_uint32 cache_hand = 0;
+
+static vic_uint32 page_cache_hash(VNode* node, vic_uint32 index) {
+    vic_uint32 key = (vic_uint32)(vic_uintptr)node ^ (index * 2654435761u);
+    return (key ^ (key >> 16)) & (cache_bucket_count - 1);
+}
+
+static void page_cache_copy(char* dest, const char* src, vic_uint32 len) {
+    for (vic_uint32 i = 0; i < len; i++) {
+        dest[i] = src[i];
+    }
+}
+
+// Find a cached page
+static CachePage* page_cache_lookup(VNode* node, vic_uint32 index) {
+    int slot = cache_buckets[page_cache_hash(node, index)];
+    while (slot != -1) {
+        CachePage* page = &cache_pages[slot];
+        if (page->node == node && page->index == index) {
+            return page;
+        }
+        slot = page->hash_next;
+    }
+    return nullptr;
+}
+
+static void page_cache_unlink(CachePage* page) {
+    int target = page - cache_pages;
+    int* link = &cache_buckets[page_cache_hash(page->node, page->index)];
+    while (*link != -1) {
+        if (*link == target) {
+            *link = page->hash_next;
+            break;
+        }
+        link = &cache_pages[*link].hash_next;
+    }
+    page->used = false;
+}
+
+// Write the dirty range of a page back to its backend
+static int page_cache_writeback(CachePage* page) {
+    if (!page->dirty) {
+        return VFS_OK;
+    }
+
+    VNode* node = page->node;
+    vic_uint32 len = page->dirty_end - page->dirty_start;
+    int written = node->mount->ops->write(node, page->index * PAGE_CACHE_PAGE_SIZE + page->dirty_start,
+                                          page->data + page->dirty_start, len);
+    if (written < 0) {
+        return written;
+    }
+    if ((vic_uint32)written != len) {
+        return VFS_ERR_NO_SPACE;
+    }
+
+    page->dirty = false;
+    return VFS_OK;
+}
+
+// Restore the heap below root in cache_order[0..count), largest index on top
+static void page_cache_sift(vic_uint32 root, vic_uint32 count) {
+    for (;;) {
+        vic_uint32 child = 2 * root + 1;
+        if (child >= count) {
+            return;
+        }
+        if (child + 1 < count &&
+            cache_pages[cache_order[child + 1]].index > cache_pages[cache_order[child]].index) {
+            child++;
+        }
+        if (cache_pages[cache_order[root]].index >= cache_pages[cache_order[child]].index) {
+            return;
+        }
+        int slot = cache_order[root];
+        cache_order[root] = cache_order[child];
+        cache_order[child] = slot;
+        root = child;
+    }
+}
+
+// Write back the dirty pages of owner up to page index last, lowest index
+// first, so the backend never sees a write past the end of what it holds;
+// FatFs would fill such a gap with whatever the new clusters contained
+// Stops at the first failure, leaving the later pages dirty
+static int page_cache_writeback_ordered(VNode* owner, vic_uint32 last) {
+    vic_uint32 count = 0;
+    for (vic_uint32 j = 0; j < cache_page_count; j++) {
+        CachePage* page = &cache_pages[j];
+        if (page->used && page->dirty && page->node == owner && page->index <= last) {
+            cache_order[count++] = j;
+        }
+    }
+
+    // Heapsort by page index
+    for (vic_uint32 i = count / 2; i > 0; i--) {
+        page_cache_sift(i - 1, count);
+    }
+    for (vic_uint32 end = count; end > 1; end--) {
+        int slot = cache_order[0];
+        cache_order[0] = cache_order[end - 1];
+        cache_order[end - 1] = slot;
+        page_cache_sift(0, end - 1);
+    }
+
+    for (vic_uint32 i = 0; i < count; i++) {
+        int result = page_cache_writeback(&cache_pages[cache_order[i]]);
+        if (result < 0) {
+            return result;
+        }
+    }
+    return VFS_OK;
+}
+
+// Take a free page, evicting with CLOCK when the cache is full
+static CachePage* page_cache_alloc() {
+    for (vic_uint32 i = 0; i < cache_page_count; i++) {
+        if (!cache_pages[i].used) {
+            return &cache_pages[i];
+        }
+    }
+
+    // Two sweeps: the first clears reference bits, the second must find
+    // a victim unless every dirty page fails to write back
+    for (vic_uint32 n = 0; n < 2 * cache_page_count; n++) {
+        CachePage* page = &cache_pages[cache_hand];
+        cache_hand = (cache_hand + 1) % cache_page_count;
+
+        if (page->referenced) {
+            page->referenced = false;
+            continue;
+        }
+        if (page->dirty && page_cache_writeback_ordered(page->node, page->index) < 0) {
+            continue;
+        }
+
+        page_cache_unlink(page);
+        return page;
+    }
+
+    return nullptr;
+}
+
+// Get a page of node, filling it from the backend on a miss
+// Pages past the end of the file, or about to be overwritten whole,
+// start out empty instead
+static int page_cache_get(VNode* node, vic_uint32 index, bool fill, CachePage** out) {
+    CachePage* page = page_cache_lookup(node, index);
+    if (page) {
+        page->referenced = true;
+        *out = page;
+        return VFS_OK;
+    }
+
+    page = page_cache_alloc();
+    if (!page) {
+        return VFS_ERR_IO;
+    }
+
+    vic_uint32 page_offset = index * PAGE_CACHE_PAGE_SIZE;
+    page->valid = 0;
+    if (fill && page_offset < node->size) {
+        vic_uint32 len = node->size - page_offset;
+        if (len > PAGE_CACHE_PAGE_SIZE) {
+            len = PAGE_CACHE_PAGE_SIZE;
+        }
+
+        int count = node->mount->ops->read(node, page_offset, page->data, len);
+        if (count < 0) {
+            return count;
+        }
+        page->valid = count;
+    }
+
+    page->used = true;
+    page->dirty = false;
+    page->referenced = true;
+    page->node = node;
+    page->index = index;
+
+    vic_uint32 bucket = page_cache_hash(node, index);
+    page->hash_next = cache_buckets[bucket];
+    cache_buckets[bucket] = page - cache_pages;
+
+    *out = page;
+    return VFS_OK;
+}
+
+// Size the cache to memory and take its pages
+static void page_cache_setup() {
+    vic_uint32 pages = pmm_total_pages() / PAGE_CACHE_SHARE;
+    if (pages < PAGE_CACHE_MIN_PAGES) {
+        pages = PAGE_CACHE_MIN_PAGES;
+    }
+    if (pages > PAGE_CACHE_MAX_PAGES) {
+        pages = PAGE_CACHE_MAX_PAGES;
+    }
+    vic_uint32 buckets = 1;
+    while (buckets < 2 * pages) {
+        buckets <<= 1;
+    }
+
+    cache_pages = (CachePage*)kmalloc(pages * sizeof(CachePage));
+    cache_buckets = (int*)kmalloc(buckets * sizeof(int));
+    cache_order = (int*)kmalloc(pages * sizeof(int));
+    if (!cache_pages || !cache_buckets || !cache_order) {
+        kfree(cache_pages);
+        kfree(cache_buckets);
+        kfree(cache_order);
+        cache_pages = nullptr;
+        kprint("Page cache: not enough memory\n");
+        return;
+    }
+
+    // Settle for fewer pages if memory is short
+    vic_uint32 count = 0;
+    while (count < pages) {
+        vic_uint32 data = pmm_alloc_page();
+        if (!data) {
+            break;
+        }
+        cache_pages[count++].data = (char*)(vic_uintptr)data;
+    }
+    cache_page_count = count;
+    cache_bucket_count = buckets;
+}
+
+// Initialize the page cache
+void page_cache_init() {
+    if (!cache_pages) {
+        page_cache_setup();
+    }
+    for (vic_uint32 i = 0; i < cache_page_count; i++) {
+        cache_pages[i].used = false;
+    }
+    for (vic_uint32 i = 0; i < cache_bucket_count; i++) {
+        cache_buckets[i] = -1;
+    }
+    cache_hand = 0;
+}
+
+// Number of pages the cache holds
+vic_uint32 page_cache_size() {
+    return cache_page_count;
+}
+
+// Read file data through the cache
+// The caller has already clamped len to the file size
+int page_cache_read(VNode* node, vic_uint32 offset, void* buf, vic_uint32 len) {
+    char* dest = (char*)buf;
+    vic_uint32 done = 0;
+
+    while (done < len) {
+        vic_uint32 pos = offset + done;
+        vic_uint32 in_page = pos % PAGE_CACHE_PAGE_SIZE;
+
+        CachePage* page;
+        int result = page_cache_get(node, pos / PAGE_CACHE_PAGE_SIZE, true, &page);
+        if (result < 0) {
+            return done > 0 ? (int)done : result;
+        }
+        if (in_page >= page->valid) {
+            break; // Backend returned less than the file size promised
+        }
+
+        vic_uint32 chunk = page->valid - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+        page_cache_copy(dest + done, page->data + in_page, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+// Write file data into the cache, marking pages dirty
+int page_cache_write(VNode* node, vic_uint32 offset, const void* buf, vic_uint32 len) {
+    const char* src = (const char*)buf;
+    vic_uint32 done = 0;
+
+    while (done < len) {
+        vic_uint32 pos = offset + done;
+        vic_uint32 in_page = pos % PAGE_CACHE_PAGE_SIZE;
+        vic_uint32 chunk = PAGE_CACHE_PAGE_SIZE - in_page;
+        if (chunk > len - done) {
+            chunk = len - done;
+        }
+
+        // A page overwritten whole needs no read from the backend
+        bool whole = (in_page == 0 && chunk == PAGE_CACHE_PAGE_SIZE);
+
+        CachePage* page;
+        int result = page_cache_get(node, pos / PAGE_CACHE_PAGE_SIZE, !whole, &page);
+        if (result < 0) {
+            return done > 0 ? (int)done : result;
+        }
+
+        // Writing past the valid data leaves a zero-filled hole
+        vic_uint32 start = (page->valid < in_page) ? page->valid : in_page;
+        for (vic_uint32 i = page->valid; i < in_page; i++) {
+            page->data[i] = '\0';
+        }
+
+        page_cache_copy(page->data + in_page, src + done, chunk);
+        if (in_page + chunk > page->valid) {
+            page->valid = in_page + chunk;
+        }
+
+        if (!page->dirty || start < page->dirty_start) {
+            page->dirty_start = start;
+        }
+        if (!page->dirty || in_page + chunk > page->dirty_end) {
+            page->dirty_end = in_page + chunk;
+        }
+        page->dirty = true;
+        done += chunk;
+    }
+
+    return done;
+}
+
+// Push file data from offset to the end straight out of cached pages
+int page_cache_stream(VNode* node, vic_uint32 offset, VfsSink sink) {
+    vic_uint32 done = 0;
+
+    while (offset + done < node->size) {
+        vic_uint32 pos = offset + done;
+        vic_uint32 in_page = pos % PAGE_CACHE_PAGE_SIZE;
+
+        CachePage* page;
+        int result = page_cache_get(node, pos / PAGE_CACHE_PAGE_SIZE, true, &page);
+        if (result < 0) {
+            return done > 0 ? (int)done : result;
+        }
+        if (in_page >= page->valid) {
+            break;
+        }
+
+        vic_uint32 chunk = page->valid - in_page;
+        if (chunk > node->size - pos) {
+            chunk = node->size - pos;
+        }
+        sink(page->data + in_page, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+// Write back dirty pages of node (every node if null)
+// Pages are written in index order so backends see sequential writes
+int page_cache_flush(VNode* node) {
+    int status = VFS_OK;
+
+    for (vic_uint32 i = 0; i < cache_page_count; i++) {
+        CachePage* page = &cache_pages[i];
+        if (!page->used || !page->dirty || (node && page->node != node)) {
+            continue;
+        }
+
+        // Writes back every dirty page of this file in one pass
+        int result = page_cache_writeback_ordered(page->node, 0xFFFFFFFF);
+        if (result < 0) {
+            status = result;
+        }
+    }
+
+    return status;
+}
+
+// Drop all pages of node without writing them back
+void page_cache_invalidate(VNode* node) {
+    for (vic_uint32 i = 0; i < cache_page_count; i++) {
+        if (cache_pages[i].used && cache_pages[i].node == node) {
+            page_cache_unlink(&cache_pages[i]);
+        }
+    }
+}
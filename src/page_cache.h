@@ -0,0 +1,35 @@
+// src/page_cache.h
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "vfs.h"
+
+// Page size. The cache takes 1/PAGE_CACHE_SHARE of memory, within
+// [PAGE_CACHE_MIN_PAGES, PAGE_CACHE_MAX_PAGES] pages.
+#define PAGE_CACHE_PAGE_SIZE 4096
+#define PAGE_CACHE_SHARE 32
+#define PAGE_CACHE_MIN_PAGES 32
+#define PAGE_CACHE_MAX_PAGES 1024
+
+// File data cache shared by every mounted filesystem. Pages are keyed by
+// (vnode, page index), evicted with CLOCK and written back when evicted,
+// flushed or when the file is last closed. Only the byte range a page had
+// changed is written back, so appending a line costs a write of the line.
+void page_cache_init();
+
+// Number of pages the cache holds
+vic_uint32 page_cache_size();
+int page_cache_read(VNode* node, vic_uint32 offset, void* buf, vic_uint32 len);
+int page_cache_write(VNode* node, vic_uint32 offset, const void* buf, vic_uint32 len);
+int page_cache_stream(VNode* node, vic_uint32 offset, VfsSink sink);
+
+// Write back dirty pages of node (every node if null)
+int page_cache_flush(VNode* node);
+
+// Drop all pages of node without writing them back
+void page_cache_invalidate(VNode* node);
+
+#endif // PAGE_CACHE_H
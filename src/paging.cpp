@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "paging.h"
+#include "pmm.h"
+
+// Forward declarations
+void kprint(const char* str);
+
+// Page directory/table entry bits
+#define PTE_PRESENT 0x001
+#define PTE_WRITE   0x002
+#define PTE_PWT     0x008
+#define PTE_PCD     0x010
+#define PTE_LARGE   0x080   // Directory entry maps a 4 MiB page
+#define PTE_GLOBAL  0x100
+
+// Memory types. The PAT entry is picked by PCD and PWT; entry 1 (PWT
+// alone) is reprogrammed from write-through to write-combining.
+#define PAGING_CACHE_WB 0
+#define PAGING_CACHE_WC PTE_PWT
+#define PAGING_CACHE_UC (PTE_PCD | PTE_PWT)
+
+#define MSR_PAT 0x277
+#define PAT_TYPE_WC 0x01
+
+// CPUID leaf 1 EDX features
+#define CPUID_PSE (1u << 3)
+#define CPUID_PGE (1u << 13)
+#define CPUID_PAT (1u << 16)
+
+#define CR0_WP (1u << 16)
+#define CR0_PG (1u << 31)
+#define CR4_PSE (1u << 4)
+#define CR4_PGE (1u << 7)
+
+// Legacy VGA window (graphics and text modes)
+#define PAGING_VGA_START 0xA0000
+#define PAGING_VGA_END 0xC0000
+
+// RAM assumed when the boot loader gave no memory map
+#define PAGING_DEFAULT_RAM 0x10000000
+
+static vic_uint32 paging_directory[1024] __attribute__((aligned(4096)));
+static vic_uint32 paging_low_table[1024] __attribute__((aligned(4096)));
+
+bool paging_enabled = false;
+bool paging_have_pat = false;
+vic_uint32 paging_global = 0;      // PTE_GLOBAL when the CPU supports it
+
+static inline void paging_cpuid(vic_uint32 leaf, vic_uint32* edx) {
+    vic_uint32 a, b, c;
+    asm volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline void paging_invlpg(vic_uint32 addr) {
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+// Set PAT entry 1 to write-combining; caches are flushed around the change
+static void paging_setup_pat() {
+    vic_uint32 lo, hi;
+    asm volatile ("wbinvd" : : : "memory");
+    asm volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_PAT));
+    lo = (lo & ~0xFF00u) | (PAT_TYPE_WC << 8);
+    asm volatile ("wrmsr" : : "a"(lo), "d"(hi), "c"(MSR_PAT));
+    asm volatile ("wbinvd" : : : "memory");
+}
+
+void paging_init() {
+    vic_uint32 features;
+    paging_cpuid(1, &features);
+    if (!(features & CPUID_PSE)) {
+        kprint("Warning: CPU has no 4 MiB pages, paging left off\n");
+        return;
+    }
+    if (features & CPUID_PGE) {
+        paging_global = PTE_GLOBAL;
+    }
+    if (features & CPUID_PAT) {
+        paging_setup_pat();
+        paging_have_pat = true;
+    }
+
+    vic_uint32 ram_end = pmm_memory_end();
+    if (ram_end == 0) {
+        ram_end = PAGING_DEFAULT_RAM;
+    }
+
+    // First 4 MiB in 4 KiB pages so the VGA window gets its own type
+    for (vic_uint32 i = 0; i < 1024; i++) {
+        vic_uint32 addr = i * PMM_PAGE_SIZE;
+        vic_uint32 cache = PAGING_CACHE_WB;
+        if (paging_have_pat && addr >= PAGING_VGA_START && addr < PAGING_VGA_END) {
+            cache = PAGING_CACHE_WC;
+        }
+        paging_low_table[i] = addr | PTE_PRESENT | PTE_WRITE | paging_global | cache;
+    }
+    paging_directory[0] = (vic_uint32)(vic_uintptr)paging_low_table | PTE_PRESENT | PTE_WRITE;
+
+    // The rest in 4 MiB pages: RAM write-back, device space above it uncached
+    for (vic_uint32 i = 1; i < 1024; i++) {
+        vic_uint32 addr = i * PAGING_LARGE_PAGE;
+        vic_uint32 cache = (addr < ram_end) ? PAGING_CACHE_WB : PAGING_CACHE_UC;
+        paging_directory[i] = addr | PTE_PRESENT | PTE_WRITE | PTE_LARGE | paging_global | cache;
+    }
+
+    vic_uint32 cr0, cr4;
+    asm volatile ("mov %0, %%cr3" : : "r"((vic_uint32)(vic_uintptr)paging_directory) : "memory");
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_PSE;
+    if (paging_global) {
+        cr4 |= CR4_PGE;
+    }
+    asm volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+
+    // Write-protect is honoured in ring 0 too, ready for read-only mappings
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= CR0_PG | CR0_WP;
+    asm volatile ("mov %0, %%cr0" : : "r"(cr0) : "memory");
+    paging_enabled = true;
+
+    kprint("Paging: identity mapped in 4 MiB pages");
+    kprint(paging_have_pat ? ", VGA write-combining\n" : "\n");
+}
+
+int paging_map_framebuffer(vic_uint32 addr, vic_uint32 size) {
+    if (!paging_enabled || !paging_have_pat || size == 0) {
+        return -1;
+    }
+
+    vic_uint32 last = addr + (size - 1);
+    if (last < addr) {
+        last = 0xFFFFFFFF;
+    }
+
+    // Below 4 MiB individual small pages, above that whole large pages
+    for (vic_uint32 dir = addr / PAGING_LARGE_PAGE; dir <= last / PAGING_LARGE_PAGE; dir++) {
+        if (dir == 0) {
+            vic_uint32 end = (last < PAGING_LARGE_PAGE) ? last / PMM_PAGE_SIZE : 1023;
+            for (vic_uint32 i = addr / PMM_PAGE_SIZE; i <= end; i++) {
+                paging_low_table[i] = (paging_low_table[i] & ~PAGING_CACHE_UC) | PAGING_CACHE_WC;
+                paging_invlpg(i * PMM_PAGE_SIZE);
+            }
+        } else {
+            paging_directory[dir] = (paging_directory[dir] & ~PAGING_CACHE_UC) | PAGING_CACHE_WC;
+            paging_invlpg(dir * PAGING_LARGE_PAGE);
+        }
+    }
+    return 0;
+}
+
+bool paging_is_enabled() {
+    return paging_enabled;
+}
@@ -0,0 +1,25 @@
+// src/paging.h
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// Bytes mapped by one page directory entry with 4 MiB pages (PSE)
+#define PAGING_LARGE_PAGE 0x400000
+
+// Turn on paging with an identity map of the whole 32-bit space: RAM in
+// 4 MiB write-back pages, everything above it uncached for devices. The
+// first 4 MiB uses 4 KiB pages so the VGA window can be write-combining.
+// Call after pmm_init, which tells where RAM ends.
+void paging_init();
+
+// Map a linear framebuffer write-combining. The range is widened to whole
+// pages, so it should not share a 4 MiB page with other devices.
+// Returns 0 on success, -1 when paging or PAT is unavailable
+int paging_map_framebuffer(vic_uint32 addr, vic_uint32 size);
+
+bool paging_is_enabled();
+
+#endif // PAGING_H
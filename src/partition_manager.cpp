@@ -11,6 +11,7 @@ vic_uint32 disk_get_size();
 
 // Partition types
 #define PART_TYPE_EMPTY     0x00
+#define PART_TYPE_EXFAT     0x07
 #define PART_TYPE_FAT32     0x0C
 #define PART_TYPE_FAT32_LBA 0x0C
 #define PART_TYPE_VICOS     0x7F  // Custom type for VicOS
@@ -103,7 +104,7 @@ int create_partition_table() {
 }
 
 // Create a new VicOS partition that uses the entire disk
-int create_vicos_partition() {
+int create_vicos_partition(bool use_exfat) {
     MBR mbr;
 
     // Read current MBR
@@ -130,7 +131,7 @@ int create_vicos_partition() {
 
     // Set up partition 1 to use the entire disk (minus the MBR)
     mbr.partitions[0].bootable = 0x80; // Bootable
-    mbr.partitions[0].system_id = PART_TYPE_FAT32_LBA;
+    mbr.partitions[0].system_id = use_exfat ? PART_TYPE_EXFAT : PART_TYPE_FAT32_LBA;
     mbr.partitions[0].start_lba = 2048; // Standard starting position for alignment
     mbr.partitions[0].sector_count = total_sectors - 2048;
 
@@ -205,6 +206,8 @@ void print_partition_table() {
 
         if (part->system_id == PART_TYPE_FAT32 || part->system_id == PART_TYPE_FAT32_LBA) {
             kprint(" (FAT32)\n");
+        } else if (part->system_id == PART_TYPE_EXFAT) {
+            kprint(" (exFAT)\n");
         } else if (part->system_id == PART_TYPE_VICOS) {
             kprint(" (VicOS)\n");
         } else {
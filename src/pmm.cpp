@@ -0,0 +1,354 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "pmm.h"
+#include "interrupts.h"
+
+// Forward declarations
+void kprint(const char* str);
+
+// Kernel image bounds (linker.ld)
+extern "C" char kernel_start[];
+extern "C" char kernel_end[];
+
+// The first MiB (BIOS data, VGA memory, option ROMs) is never handed out
+#define PMM_LOW_LIMIT 0x100000
+
+// Highest address managed: the last page below 4 GiB
+#define PMM_HIGH_LIMIT 0xFFFFF000u
+
+// Ends a free list
+#define PMM_NONE 0xFFFFFFFFu
+
+// Page state: a free block's first page has PMM_STATE_FREE set and its
+// order in the low bits; every other page is 0
+#define PMM_STATE_FREE 0x80
+
+#define PMM_MAX_REGIONS 32
+#define PMM_MAX_RESERVED 4
+
+// Links of a free block, kept in its first page
+struct PmmFreeBlock {
+    vic_uint32 next;          // Page number, PMM_NONE ends the list
+    vic_uint32 prev;
+};
+
+struct PmmRange {
+    vic_uint32 start;
+    vic_uint32 end;
+};
+
+// Usable memory from the boot information
+PmmRange pmm_regions[PMM_MAX_REGIONS];
+vic_uint32 pmm_region_count = 0;
+
+// Memory that must not be handed out while adding the regions
+PmmRange pmm_reserved[PMM_MAX_RESERVED];
+vic_uint32 pmm_reserved_count = 0;
+
+// One state byte per page below pmm_page_limit; the array itself lives
+// in usable memory found at boot, sized to the machine
+vic_uint8* pmm_state = nullptr;
+vic_uint32 pmm_page_limit = 0;
+
+// Free lists, one per order
+vic_uint32 pmm_free_head[PMM_MAX_ORDER + 1];
+vic_uint32 pmm_free_count[PMM_MAX_ORDER + 1];
+
+vic_uint32 pmm_usable_pages = 0;
+vic_uint32 pmm_free_total = 0;
+vic_uint32 pmm_peak_used = 0;
+
+static PmmFreeBlock* pmm_block(vic_uint32 pfn) {
+    return (PmmFreeBlock*)(vic_uintptr)(pfn * PMM_PAGE_SIZE);
+}
+
+static void pmm_print_number(vic_uint32 value) {
+    char digits[12];
+    int idx = 0;
+    do {
+        digits[idx++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    char out[12];
+    for (int i = 0; i < idx; i++) {
+        out[i] = digits[idx - i - 1];
+    }
+    out[idx] = '\0';
+    kprint(out);
+}
+
+static void pmm_list_push(vic_uint32 pfn, vic_uint32 order) {
+    PmmFreeBlock* block = pmm_block(pfn);
+    block->next = pmm_free_head[order];
+    block->prev = PMM_NONE;
+    if (block->next != PMM_NONE) {
+        pmm_block(block->next)->prev = pfn;
+    }
+    pmm_free_head[order] = pfn;
+    pmm_free_count[order]++;
+    pmm_state[pfn] = PMM_STATE_FREE | order;
+}
+
+static void pmm_list_remove(vic_uint32 pfn, vic_uint32 order) {
+    PmmFreeBlock* block = pmm_block(pfn);
+    if (block->prev != PMM_NONE) {
+        pmm_block(block->prev)->next = block->next;
+    } else {
+        pmm_free_head[order] = block->next;
+    }
+    if (block->next != PMM_NONE) {
+        pmm_block(block->next)->prev = block->prev;
+    }
+    pmm_free_count[order]--;
+    pmm_state[pfn] = 0;
+}
+
+// Put a block on its free list, merging it with free buddies
+static void pmm_free_block(vic_uint32 pfn, vic_uint32 order) {
+    while (order < PMM_MAX_ORDER) {
+        vic_uint32 buddy = pfn ^ (1u << order);
+        if (buddy >= pmm_page_limit || pmm_state[buddy] != (PMM_STATE_FREE | order)) {
+            break;
+        }
+        pmm_list_remove(buddy, order);
+        pfn &= ~(1u << order);
+        order++;
+    }
+    pmm_list_push(pfn, order);
+}
+
+// Hand the pages of [start, end) to the allocator, skipping reserved
+// ranges from index first on
+static void pmm_add_range(vic_uint32 start, vic_uint32 end, vic_uint32 first) {
+    for (vic_uint32 i = first; i < pmm_reserved_count; i++) {
+        PmmRange* r = &pmm_reserved[i];
+        if (r->start < end && r->end > start) {
+            if (start < r->start) {
+                pmm_add_range(start, r->start, i + 1);
+            }
+            if (r->end < end) {
+                pmm_add_range(r->end, end, i + 1);
+            }
+            return;
+        }
+    }
+
+    // Whole pages only, in the largest aligned blocks that fit
+    vic_uint32 pfn = (start + PMM_PAGE_SIZE - 1) / PMM_PAGE_SIZE;
+    vic_uint32 last = end / PMM_PAGE_SIZE;
+    while (pfn < last) {
+        vic_uint32 order = 0;
+        while (order < PMM_MAX_ORDER && (pfn & ((2u << order) - 1)) == 0 &&
+               pfn + (2u << order) <= last) {
+            order++;
+        }
+        pmm_free_block(pfn, order);
+        pmm_usable_pages += 1u << order;
+        pmm_free_total += 1u << order;
+        pfn += 1u << order;
+    }
+}
+
+static void pmm_reserve(vic_uint32 start, vic_uint32 end) {
+    if (pmm_reserved_count < PMM_MAX_RESERVED && start < end) {
+        pmm_reserved[pmm_reserved_count].start = start;
+        pmm_reserved[pmm_reserved_count].end = end;
+        pmm_reserved_count++;
+    }
+}
+
+// Record a usable region, clipped to [PMM_LOW_LIMIT, PMM_HIGH_LIMIT)
+static void pmm_add_region(vic_uint64 addr, vic_uint64 len) {
+    vic_uint64 start = addr;
+    vic_uint64 end = addr + len;
+    if (start < PMM_LOW_LIMIT) {
+        start = PMM_LOW_LIMIT;
+    }
+    if (end > PMM_HIGH_LIMIT) {
+        end = PMM_HIGH_LIMIT;
+    }
+    if (start >= end || pmm_region_count == PMM_MAX_REGIONS) {
+        return;
+    }
+
+    pmm_regions[pmm_region_count].start = (vic_uint32)start;
+    pmm_regions[pmm_region_count].end = (vic_uint32)end;
+    pmm_region_count++;
+}
+
+// Find room for size bytes in a usable region, clear of reserved ranges
+// Returns the page-aligned address, or 0
+static vic_uint32 pmm_place(vic_uint32 size) {
+    for (vic_uint32 i = 0; i < pmm_region_count; i++) {
+        vic_uint32 at = (pmm_regions[i].start + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+
+        // Step past reserved ranges until nothing overlaps
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (vic_uint32 r = 0; r < pmm_reserved_count; r++) {
+                if (pmm_reserved[r].start < at + size && pmm_reserved[r].end > at) {
+                    at = (pmm_reserved[r].end + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+                    moved = true;
+                }
+            }
+        }
+
+        if (at <= pmm_regions[i].end && size <= pmm_regions[i].end - at) {
+            return at;
+        }
+    }
+    return 0;
+}
+
+// Build the allocator from the Multiboot information
+void pmm_init(vic_uint32 magic, const MultibootInfo* info) {
+    for (vic_uint32 i = 0; i <= PMM_MAX_ORDER; i++) {
+        pmm_free_head[i] = PMM_NONE;
+        pmm_free_count[i] = 0;
+    }
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC || !info) {
+        kprint("Warning: not booted by a Multiboot loader, no physical memory manager\n");
+        return;
+    }
+
+    // Prefer the BIOS memory map; fall back to the size of upper memory
+    if (info->flags & MULTIBOOT_INFO_MEM_MAP) {
+        vic_uint32 pos = info->mmap_addr;
+        while (pos < info->mmap_addr + info->mmap_length) {
+            const MultibootMmapEntry* entry = (const MultibootMmapEntry*)(vic_uintptr)pos;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                pmm_add_region(entry->addr, entry->len);
+            }
+            pos += entry->size + 4;
+        }
+        pmm_reserve(info->mmap_addr, info->mmap_addr + info->mmap_length);
+    } else if (info->flags & MULTIBOOT_INFO_MEMORY) {
+        pmm_add_region(PMM_LOW_LIMIT, (vic_uint64)info->mem_upper * 1024);
+    }
+
+    vic_uint32 info_addr = (vic_uint32)(vic_uintptr)info;
+    pmm_reserve(info_addr, info_addr + sizeof(MultibootInfo));
+    pmm_reserve((vic_uint32)(vic_uintptr)kernel_start, (vic_uint32)(vic_uintptr)kernel_end);
+
+    for (vic_uint32 i = 0; i < pmm_region_count; i++) {
+        if (pmm_regions[i].end / PMM_PAGE_SIZE > pmm_page_limit) {
+            pmm_page_limit = pmm_regions[i].end / PMM_PAGE_SIZE;
+        }
+    }
+
+    // The page state array goes in the first usable spot big enough
+    vic_uint32 state_size = (pmm_page_limit + PMM_PAGE_SIZE - 1) & ~(PMM_PAGE_SIZE - 1);
+    vic_uint32 state_addr = (pmm_page_limit > 0) ? pmm_place(state_size) : 0;
+    if (state_addr == 0) {
+        kprint("Warning: no usable memory in the boot memory map\n");
+        pmm_page_limit = 0;
+        return;
+    }
+    pmm_state = (vic_uint8*)(vic_uintptr)state_addr;
+    for (vic_uint32 i = 0; i < pmm_page_limit; i++) {
+        pmm_state[i] = 0;
+    }
+    pmm_reserve(state_addr, state_addr + state_size);
+
+    for (vic_uint32 i = 0; i < pmm_region_count; i++) {
+        pmm_add_range(pmm_regions[i].start, pmm_regions[i].end, 0);
+    }
+
+    kprint("Physical memory: ");
+    pmm_print_number(pmm_usable_pages / 256);
+    kprint(" MiB usable in ");
+    pmm_print_number(pmm_region_count);
+    kprint(" region(s)\n");
+}
+
+// Allocate 2^order contiguous pages
+// Returns the physical address, or 0 when no block is free
+vic_uint32 pmm_alloc_pages(vic_uint32 order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    // Threads are preempted from interrupts; keep them off while the
+    // lists change
+    bool enabled = interrupts_save();
+
+    // Smallest non-empty list at or above the requested order
+    vic_uint32 have = order;
+    while (have <= PMM_MAX_ORDER && pmm_free_head[have] == PMM_NONE) {
+        have++;
+    }
+    if (have > PMM_MAX_ORDER) {
+        interrupts_restore(enabled);
+        return 0;
+    }
+
+    vic_uint32 pfn = pmm_free_head[have];
+    pmm_list_remove(pfn, have);
+
+    // Split, returning upper halves to the smaller lists
+    while (have > order) {
+        have--;
+        pmm_list_push(pfn + (1u << have), have);
+    }
+
+    pmm_free_total -= 1u << order;
+    if (pmm_usable_pages - pmm_free_total > pmm_peak_used) {
+        pmm_peak_used = pmm_usable_pages - pmm_free_total;
+    }
+    interrupts_restore(enabled);
+    return pfn * PMM_PAGE_SIZE;
+}
+
+// Free a block from pmm_alloc_pages with the same order
+void pmm_free_pages(vic_uint32 addr, vic_uint32 order) {
+    vic_uint32 pfn = addr / PMM_PAGE_SIZE;
+    if (addr == 0 || order > PMM_MAX_ORDER || pfn + (1u << order) > pmm_page_limit) {
+        return;
+    }
+
+    bool enabled = interrupts_save();
+    pmm_free_block(pfn, order);
+    pmm_free_total += 1u << order;
+    interrupts_restore(enabled);
+}
+
+vic_uint32 pmm_alloc_page() {
+    return pmm_alloc_pages(0);
+}
+
+void pmm_free_page(vic_uint32 addr) {
+    pmm_free_pages(addr, 0);
+}
+
+// Smallest order whose block holds bytes
+vic_uint32 pmm_order_for(vic_uint32 bytes) {
+    vic_uint32 order = 0;
+    while (order < PMM_MAX_ORDER && ((vic_uint32)PMM_PAGE_SIZE << order) < bytes) {
+        order++;
+    }
+    return order;
+}
+
+vic_uint32 pmm_total_pages() {
+    return pmm_usable_pages;
+}
+
+vic_uint32 pmm_free_page_count() {
+    return pmm_free_total;
+}
+
+vic_uint32 pmm_free_blocks(vic_uint32 order) {
+    return (order <= PMM_MAX_ORDER) ? pmm_free_count[order] : 0;
+}
+
+vic_uint32 pmm_peak_used_pages() {
+    return pmm_peak_used;
+}
+
+vic_uint32 pmm_memory_end() {
+    return pmm_page_limit * PMM_PAGE_SIZE;
+}
@@ -0,0 +1,41 @@
+// src/pmm.h
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "multiboot.h"
+
+// Physical page size
+#define PMM_PAGE_SIZE 4096
+
+// Largest block the buddy allocator hands out: 2^PMM_MAX_ORDER pages (4 MiB)
+#define PMM_MAX_ORDER 10
+
+// Physical page allocator built from the Multiboot memory map. Free memory
+// is kept in power-of-two blocks of pages, one free list per order; freed
+// blocks merge with their buddy. Physical memory is identity mapped, so a
+// returned address can be used directly as a pointer.
+void pmm_init(vic_uint32 magic, const MultibootInfo* info);
+
+// Allocate 2^order contiguous pages
+// Returns the physical address, or 0 when no block is free
+vic_uint32 pmm_alloc_pages(vic_uint32 order);
+void pmm_free_pages(vic_uint32 addr, vic_uint32 order);
+
+// Single pages
+vic_uint32 pmm_alloc_page();
+void pmm_free_page(vic_uint32 addr);
+
+// Smallest order whose block holds bytes
+vic_uint32 pmm_order_for(vic_uint32 bytes);
+
+// Memory size, for subsystems that size themselves to the machine
+vic_uint32 pmm_total_pages();       // Usable pages found at boot
+vic_uint32 pmm_free_page_count();   // Pages currently free
+vic_uint32 pmm_free_blocks(vic_uint32 order);   // Free blocks of one order
+vic_uint32 pmm_peak_used_pages();   // Most pages allocated at once
+vic_uint32 pmm_memory_end();        // End of the highest usable region, 0 if unknown
+
+#endif // PMM_H
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "timer.h"
 
 // Forward declarations
 void kprint(const char* str);
@@ -12,17 +13,25 @@ int disk_initialize();
 void disk_detect();
 int disk_get_drive_info(int drive_index, bool* exists, char* model, vic_uint32* size_mb);
 bool set_active_drive(int drive_index);
-int create_vicos_partition();
+int create_vicos_partition(bool use_exfat);
 int create_fat32_filesystem();
+int create_exfat_filesystem();
 int create_directory(const char* dirname);
 int create_file_with_content(const char* filename, const void* data, vic_uint32 size);
 
 // Forward declaration for keyboard input
 extern "C" char keyboard_read_char();
 
+// Forward declarations from vfs.cpp
+void vfs_lock();
+void vfs_unlock();
+
 // Storage device structure
 #define MAX_STORAGE_DEVICES 8
 
+// Drives at least this big default to exFAT (same cut-off as other OSes)
+#define EXFAT_RECOMMENDED_MB (32 * 1024)
+
 struct StorageDevice {
     bool detected;
     char name[8];      // e.g., "hda", "sdb"
@@ -159,9 +168,18 @@ void display_storage_devices() {
     }
 }
 
+// Wait for a key; the shell holds the VFS lock around the installer, so
+// let background writeback in while the user thinks
+char installer_read_key() {
+    vfs_unlock();
+    char c = keyboard_read_char();
+    vfs_lock();
+    return c;
+}
+
 // Get character input with echo
 char get_char_with_echo() {
-    char c = keyboard_read_char();
+    char c = installer_read_key();
     kputchar(c); // Echo character
     return c;
 }
@@ -183,7 +201,7 @@ void get_string_input(char* buffer, int max_len) {
     int pos = 0;
 
     while (pos < max_len - 1) {
-        char c = keyboard_read_char();
+        char c = installer_read_key();
 
         if (c == '\n' || c == '\r') {
             kputchar('\n');
@@ -309,6 +327,32 @@ void show_progress(const char* task, int current, int total) {
     kprint("%\n");
 }
 
+// Ask which filesystem to put on the data partition
+// Returns true for exFAT, false for FAT32
+bool choose_filesystem(const StorageDevice* dev) {
+    bool recommend_exfat = dev->size_mb >= EXFAT_RECOMMENDED_MB;
+
+    kprint("Select a filesystem for the VicOS partition:\n");
+    kprint("1: FAT32 (widest compatibility, files up to 4 GB)");
+    kprint(recommend_exfat ? "\n" : " [recommended]\n");
+    kprint("2: exFAT (large data partitions and media files over 4 GB)");
+    kprint(recommend_exfat ? " [recommended]\n" : "\n");
+    kprint("Enter your choice (1-2): ");
+
+    int choice = get_number_input();
+    kprint("\n\n");
+
+    if (choice == 1) {
+        return false;
+    }
+    if (choice == 2) {
+        return true;
+    }
+
+    // Anything else takes the recommendation
+    return recommend_exfat;
+}
+
 // Main installation function
 int install_to_device(int device_index) {
     if (device_index < 0 || device_index >= num_storage_devices) {
@@ -328,16 +372,22 @@ int install_to_device(int device_index) {
         return -1;
     }
 
+    bool use_exfat = choose_filesystem(dev);
+
     // Step 1: Create partition
     kprint("Step 1: Creating partition...\n");
-    if (create_vicos_partition() < 0) {
+    if (create_vicos_partition(use_exfat) < 0) {
         kprint("Failed to create partition\n");
         return -1;
     }
 
-    // Step 2: Create FAT32 filesystem
-    kprint("Step 2: Creating FAT32 filesystem...\n");
-    if (create_fat32_filesystem() < 0) {
+    // Step 2: Create the filesystem
+    if (use_exfat) {
+        kprint("Step 2: Creating exFAT filesystem...\n");
+    } else {
+        kprint("Step 2: Creating FAT32 filesystem...\n");
+    }
+    if ((use_exfat ? create_exfat_filesystem() : create_fat32_filesystem()) < 0) {
         kprint("Failed to create filesystem\n");
         return -1;
     }
@@ -356,10 +406,10 @@ int install_to_device(int device_index) {
     for (int i = 0; i <= 10; i++) {
         show_progress("Installing bootloader", i, 10);
 
-        // Small delay
-        for (int j = 0; j < 10000000; j++) {
-            asm volatile("nop");
-        }
+        // Small delay, letting writeback in meanwhile
+        vfs_unlock();
+        sleep_ns(100 * TIMER_NS_PER_MS);
+        vfs_lock();
     }
 
     kprint("\nVicOS has been successfully installed to /dev/");
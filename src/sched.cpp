@@ -0,0 +1,416 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "sched.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "pmm.h"
+#include "kheap.h"
+
+// Forward declarations from kernel.cpp
+void kprint(const char* str);
+
+// Forward declaration from vshellhandler.cpp
+void print_number(vic_uint32 value);
+
+// Save the callee-saved registers on the current stack, store its pointer
+// in *old_esp and resume the thread whose stack is at new_esp
+extern "C" void sched_switch(vic_uint32* old_esp, vic_uint32 new_esp);
+asm (".text\n"
+     ".globl sched_switch\n"
+     "sched_switch:\n"
+     "    movl 4(%esp), %eax\n"
+     "    movl 8(%esp), %edx\n"
+     "    pushl %ebp\n"
+     "    pushl %ebx\n"
+     "    pushl %esi\n"
+     "    pushl %edi\n"
+     "    movl %esp, (%eax)\n"
+     "    movl %edx, %esp\n"
+     "    popl %edi\n"
+     "    popl %esi\n"
+     "    popl %ebx\n"
+     "    popl %ebp\n"
+     "    ret\n");
+
+// Per-priority FIFO run queues; bit n of the bitmap is set while queue n
+// is not empty
+Thread* sched_queues[SCHED_PRIORITIES];
+vic_uint32 sched_bitmap = 0;
+
+Thread sched_boot_thread;
+Thread* sched_current = nullptr;
+Thread* sched_idle = nullptr;
+Thread* sched_threads = nullptr;    // Every thread, newest first
+Thread* sched_dead = nullptr;       // Exited, stack freed after the switch
+vic_uint32 sched_next_id = 0;
+
+// Set when a better thread became ready; acted on at IRQ exit
+bool sched_need_resched = false;
+Timer sched_slice_timer;
+vic_uint64 sched_switched_at = 0;
+
+static void sched_copy_name(Thread* thread, const char* name) {
+    int i = 0;
+    while (name[i] && i < THREAD_NAME - 1) {
+        thread->name[i] = name[i];
+        i++;
+    }
+    thread->name[i] = '\0';
+}
+
+static void sched_enqueue(Thread* thread) {
+    Thread** head = &sched_queues[thread->priority];
+    if (*head) {
+        // Circular list: the tail is head->prev
+        thread->next = *head;
+        thread->prev = (*head)->prev;
+        (*head)->prev->next = thread;
+        (*head)->prev = thread;
+    } else {
+        thread->next = thread;
+        thread->prev = thread;
+        *head = thread;
+        sched_bitmap |= 1u << thread->priority;
+    }
+    thread->state = THREAD_READY;
+}
+
+static Thread* sched_dequeue() {
+    if (sched_bitmap == 0) {
+        return nullptr;
+    }
+
+    vic_uint32 priority = __builtin_ctz(sched_bitmap);
+    Thread** head = &sched_queues[priority];
+    Thread* thread = *head;
+    if (thread->next == thread) {
+        *head = nullptr;
+        sched_bitmap &= ~(1u << priority);
+    } else {
+        thread->prev->next = thread->next;
+        thread->next->prev = thread->prev;
+        *head = thread->next;
+    }
+    thread->next = nullptr;
+    thread->prev = nullptr;
+    return thread;
+}
+
+static void sched_slice_expired(void* /* data */) {
+    sched_need_resched = true;
+}
+
+// Make a blocked thread runnable and note whether it should preempt the
+// current one. Interrupts must be off.
+static void sched_make_ready(Thread* thread) {
+    if (thread->state != THREAD_BLOCKED) {
+        return;
+    }
+    sched_enqueue(thread);
+
+    if (sched_current == sched_idle || thread->priority < sched_current->priority) {
+        sched_need_resched = true;
+    } else if (thread->priority == sched_current->priority && !sched_slice_timer.armed) {
+        timer_start(&sched_slice_timer, SCHED_SLICE_NS, 0, sched_slice_expired, nullptr);
+    }
+}
+
+// Free the stack of a thread that exited; runs on another thread's stack
+static void sched_reap() {
+    Thread* dead = sched_dead;
+    if (!dead || dead == sched_current) {
+        return;
+    }
+    sched_dead = nullptr;
+
+    for (Thread** link = &sched_threads; *link; link = &(*link)->all_next) {
+        if (*link == dead) {
+            *link = dead->all_next;
+            break;
+        }
+    }
+    pmm_free_pages(dead->stack, THREAD_STACK_ORDER);
+    kfree(dead);
+}
+
+// Pick the next thread and switch to it. Interrupts must be off; the
+// caller has already queued or blocked the current thread as it wants.
+static void schedule() {
+    Thread* prev = sched_current;
+    if (prev->state == THREAD_RUNNING) {
+        if (prev == sched_idle) {
+            prev->state = THREAD_READY;
+        } else {
+            sched_enqueue(prev);
+        }
+    }
+
+    Thread* next = sched_dequeue();
+    if (!next) {
+        next = sched_idle;
+    }
+    sched_need_resched = false;
+
+    // Time-slice only while a thread of the same priority is waiting
+    if (next != sched_idle && sched_queues[next->priority]) {
+        timer_start(&sched_slice_timer, SCHED_SLICE_NS, 0, sched_slice_expired, nullptr);
+    } else {
+        timer_cancel(&sched_slice_timer);
+    }
+
+    next->state = THREAD_RUNNING;
+    if (next == prev) {
+        return;
+    }
+
+    vic_uint64 now = ktime_ns();
+    prev->runtime += now - sched_switched_at;
+    sched_switched_at = now;
+
+    sched_current = next;
+    sched_switch(&prev->esp, next->esp);
+
+    // Back on prev's stack, switched to by some later schedule()
+    sched_reap();
+}
+
+// First code a new thread runs, returned to from sched_switch
+static void thread_start() {
+    sched_reap();
+    interrupts_enable();
+
+    Thread* self = sched_current;
+    self->entry(self->arg);
+    thread_exit();
+}
+
+static bool sched_has_work() {
+    return sched_bitmap != 0;
+}
+
+// Runs when nothing else can; halts tickless until an interrupt makes a
+// thread ready
+static void sched_idle_loop(void* /* arg */) {
+    for (;;) {
+        timer_idle(sched_has_work);
+        sched_yield();
+    }
+}
+
+static Thread* thread_alloc(const char* name, ThreadEntry entry, void* arg, vic_uint8 priority) {
+    Thread* thread = (Thread*)kmalloc(sizeof(Thread));
+    if (!thread) {
+        return nullptr;
+    }
+    vic_uint32 stack = pmm_alloc_pages(THREAD_STACK_ORDER);
+    if (!stack) {
+        kfree(thread);
+        return nullptr;
+    }
+
+    *thread = Thread();
+    sched_copy_name(thread, name);
+    thread->stack = stack;
+    thread->priority = (priority < SCHED_PRIORITIES) ? priority : SCHED_PRIORITIES - 1;
+    thread->entry = entry;
+    thread->arg = arg;
+
+    // Frame for sched_switch to pop: edi, esi, ebx, ebp, then return
+    // into thread_start, whose own return address is never used
+    vic_uint32* top = (vic_uint32*)(vic_uintptr)(stack + (PMM_PAGE_SIZE << THREAD_STACK_ORDER));
+    *--top = 0;
+    *--top = (vic_uint32)(vic_uintptr)thread_start;
+    *--top = 0;
+    *--top = 0;
+    *--top = 0;
+    *--top = 0;
+    thread->esp = (vic_uint32)(vic_uintptr)top;
+
+    bool enabled = interrupts_save();
+    thread->id = sched_next_id++;
+    thread->all_next = sched_threads;
+    sched_threads = thread;
+    interrupts_restore(enabled);
+    return thread;
+}
+
+void sched_init() {
+    Thread* boot = &sched_boot_thread;
+    sched_copy_name(boot, "main");
+    boot->id = sched_next_id++;
+    boot->priority = SCHED_PRIORITY_NORMAL;
+    boot->state = THREAD_RUNNING;
+    sched_threads = boot;
+    sched_current = boot;
+
+    sched_idle = thread_alloc("idle", sched_idle_loop, nullptr, SCHED_PRIORITIES - 1);
+    if (!sched_idle) {
+        kprint("Scheduler: no memory for the idle thread\n");
+        sched_current = nullptr;
+        return;
+    }
+    sched_idle->state = THREAD_READY;
+    sched_switched_at = ktime_ns();
+
+    kprint("Scheduler: ");
+    print_number(SCHED_PRIORITIES);
+    kprint(" priorities, ");
+    print_number((vic_uint32)(SCHED_SLICE_NS / TIMER_NS_PER_MS));
+    kprint(" ms slice\n");
+}
+
+bool sched_running() {
+    return sched_current != nullptr;
+}
+
+// Called by irq_dispatch after the EOI, still on the interrupted stack.
+// The idle thread is left alone: it reschedules itself as soon as the
+// halt it is in returns, which keeps its idle time accounting exact.
+void sched_irq_exit() {
+    if (sched_need_resched && sched_current && sched_current != sched_idle) {
+        schedule();
+    }
+}
+
+Thread* thread_create(const char* name, ThreadEntry entry, void* arg, vic_uint8 priority) {
+    if (!sched_running()) {
+        return nullptr;
+    }
+    Thread* thread = thread_alloc(name, entry, arg, priority);
+    if (!thread) {
+        return nullptr;
+    }
+
+    bool enabled = interrupts_save();
+    thread->state = THREAD_BLOCKED;
+    sched_make_ready(thread);
+    if (enabled && sched_need_resched) {
+        schedule();
+    }
+    interrupts_restore(enabled);
+    return thread;
+}
+
+void thread_exit() {
+    interrupts_disable();
+    Thread* self = sched_current;
+    self->state = THREAD_DEAD;
+    if (self->stack) {
+        sched_dead = self;
+    }
+    schedule();
+
+    // The boot thread has no stack to free and is never switched back to
+    for (;;) {
+        asm volatile ("cli; hlt");
+    }
+}
+
+Thread* thread_current() {
+    return sched_current;
+}
+
+void sched_yield() {
+    if (!sched_running()) {
+        return;
+    }
+    bool enabled = interrupts_save();
+    schedule();
+    interrupts_restore(enabled);
+}
+
+void sched_wait(WaitQueue* queue, bool (*ready)()) {
+    bool enabled = interrupts_save();
+    while (!ready()) {
+        Thread* self = sched_current;
+        self->state = THREAD_BLOCKED;
+        self->next = queue->head;
+        queue->head = self;
+        schedule();
+    }
+    interrupts_restore(enabled);
+}
+
+void sched_wake(WaitQueue* queue) {
+    bool enabled = interrupts_save();
+    Thread* thread = queue->head;
+    queue->head = nullptr;
+    while (thread) {
+        Thread* next = thread->next;
+        thread->next = nullptr;
+        sched_make_ready(thread);
+        thread = next;
+    }
+
+    // Called from a thread rather than a handler: preempt right away
+    if (enabled && sched_need_resched) {
+        schedule();
+    }
+    interrupts_restore(enabled);
+}
+
+static void sched_sleep_expired(void* data) {
+    sched_make_ready((Thread*)data);
+}
+
+void sched_sleep_ns(vic_uint64 ns) {
+    bool enabled = interrupts_save();
+    Thread* self = sched_current;
+    timer_start(&self->sleep_timer, ns, 0, sched_sleep_expired, self);
+    self->state = THREAD_BLOCKED;
+    schedule();
+    interrupts_restore(enabled);
+}
+
+void mutex_lock(Mutex* mutex) {
+    bool enabled = interrupts_save();
+    while (mutex->owner) {
+        Thread* self = sched_current;
+        self->state = THREAD_BLOCKED;
+        self->next = mutex->waiters.head;
+        mutex->waiters.head = self;
+        schedule();
+    }
+    mutex->owner = sched_current;
+    interrupts_restore(enabled);
+}
+
+void mutex_unlock(Mutex* mutex) {
+    bool enabled = interrupts_save();
+    mutex->owner = nullptr;
+    interrupts_restore(enabled);
+    sched_wake(&mutex->waiters);
+}
+
+static const char* const sched_state_names[] = {
+    "running", "ready  ", "blocked", "dead   "
+};
+
+// Process ps command
+void process_ps(const char* /* command */) {
+    kprint("  ID PRI STATE    TIME(ms) NAME\n");
+
+    bool enabled = interrupts_save();
+    for (Thread* thread = sched_threads; thread; thread = thread->all_next) {
+        vic_uint64 runtime = thread->runtime;
+        if (thread == sched_current) {
+            runtime += ktime_ns() - sched_switched_at;
+        }
+
+        vic_uint32 ms = (vic_uint32)(runtime / TIMER_NS_PER_MS);
+
+        kprint("  ");
+        print_number(thread->id);
+        kprint("  ");
+        print_number(thread->priority);
+        kprint("  ");
+        kprint(sched_state_names[thread->state]);
+        kprint("  ");
+        print_number(ms);
+        kprint(" ");
+        kprint(thread->name);
+        kprint("\n");
+    }
+    interrupts_restore(enabled);
+}
@@ -0,0 +1,88 @@
+// src/sched.h
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "timer.h"
+
+// Priorities, 0 highest. Each has its own run queue and a bit in a
+// bitmap of non-empty queues, so picking the next thread is O(1). The
+// idle thread sits below all of them on no queue.
+#define SCHED_PRIORITIES 32
+#define SCHED_PRIORITY_HIGH 8
+#define SCHED_PRIORITY_NORMAL 16
+#define SCHED_PRIORITY_LOW 24
+
+// Threads of equal priority take turns this often
+#define SCHED_SLICE_NS (10 * TIMER_NS_PER_MS)
+
+// 16 KiB kernel stack per thread
+#define THREAD_STACK_ORDER 2
+#define THREAD_NAME 16
+
+enum ThreadState {
+    THREAD_RUNNING,
+    THREAD_READY,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+};
+
+typedef void (*ThreadEntry)(void* arg);
+
+struct Thread {
+    vic_uint32 esp;             // Saved stack pointer while switched out
+    vic_uint32 stack;           // Stack pages, 0 for the boot stack
+    char name[THREAD_NAME];
+    vic_uint32 id;
+    vic_uint8 priority;
+    ThreadState state;
+    Thread* next;               // Run queue or wait queue link
+    Thread* prev;
+    Thread* all_next;           // Every thread, for ps
+    ThreadEntry entry;
+    void* arg;
+    Timer sleep_timer;
+    vic_uint64 runtime;         // ns spent running
+};
+
+// Threads blocked until someone calls sched_wake
+struct WaitQueue {
+    Thread* head;
+};
+
+// Sleeping lock; not recursive
+struct Mutex {
+    Thread* owner;
+    WaitQueue waiters;
+};
+
+// Turn the boot context into the first thread and start the idle thread.
+// Call after timer_init.
+void sched_init();
+bool sched_running();
+
+// Returns null when out of memory. The thread starts with interrupts on
+// and exits when entry returns.
+Thread* thread_create(const char* name, ThreadEntry entry, void* arg, vic_uint8 priority);
+void thread_exit();
+Thread* thread_current();
+
+// Let other threads of the same or higher priority run
+void sched_yield();
+
+// Block until ready() holds; it is checked with interrupts off, and again
+// after every sched_wake on queue
+void sched_wait(WaitQueue* queue, bool (*ready)());
+
+// Make every thread on queue runnable. Safe from interrupt handlers.
+void sched_wake(WaitQueue* queue);
+
+// Block for at least ns
+void sched_sleep_ns(vic_uint64 ns);
+
+void mutex_lock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+
+#endif // SCHED_H
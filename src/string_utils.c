@@ -1,6 +1,7 @@
 // src/string_utils.c
 #include <stdarg.h>
 #include <stddef.h>
+#include "vstdint.h"
 
 int snprintf(char* str, vic_size_t size, const char* format, ...) {
     va_list args;
@@ -142,4 +143,45 @@ int snprintf(char* str, vic_size_t size, const char* format, ...) {
     
     va_end(args);
     return count;
-}
\ No newline at end of file
+}
+
+// Memory and string operations FatFs and compiler-generated struct copies call
+void* memcpy(void* dest, const void* src, vic_size_t n) {
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--) {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+void* memset(void* dest, int value, vic_size_t n) {
+    unsigned char* d = (unsigned char*)dest;
+    while (n--) {
+        *d++ = (unsigned char)value;
+    }
+    return dest;
+}
+
+int memcmp(const void* a, const void* b, vic_size_t n) {
+    const unsigned char* p1 = (const unsigned char*)a;
+    const unsigned char* p2 = (const unsigned char*)b;
+    while (n--) {
+        if (*p1 != *p2) {
+            return *p1 - *p2;
+        }
+        p1++;
+        p2++;
+    }
+    return 0;
+}
+
+char* strchr(const char* str, int c) {
+    while (*str) {
+        if (*str == (char)c) {
+            return (char*)str;
+        }
+        str++;
+    }
+    return (c == 0) ? (char*)str : NULL;
+}
@@ -3,12 +3,17 @@
 #define STRING_UTILS_H
 
 #include <stddef.h>
+#include "vstdint.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int snprintf(char* str, vic_size_t size, const char* format, ...);
+void* memcpy(void* dest, const void* src, vic_size_t n);
+void* memset(void* dest, int value, vic_size_t n);
+int memcmp(const void* a, const void* b, vic_size_t n);
+char* strchr(const char* str, int c);
 
 #ifdef __cplusplus
 }
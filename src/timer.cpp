@@ -0,0 +1,468 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "timer.h"
+#include "interrupts.h"
+
+// Forward declarations from kernel.cpp
+void kprint(const char* str);
+
+// Forward declaration from vshellhandler.cpp
+void print_number(vic_uint32 value);
+
+// Forward declarations from sched.cpp
+bool sched_running();
+void sched_sleep_ns(vic_uint64 ns);
+
+// IO port functions
+static inline void outb(vic_uint16 port, vic_uint8 val) {
+    asm volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline vic_uint8 inb(vic_uint16 port) {
+    vic_uint8 ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// 8253/8254 PIT
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_CH0_RATE 0x34           // Channel 0, lo/hi byte, mode 2
+#define PIT_CH0_ONESHOT 0x30        // Channel 0, lo/hi byte, mode 0
+#define PIT_TICK_COUNT (PIT_FREQUENCY / TIMER_HZ)
+#define PIT_MAX_COUNT 0xFFFF
+#define PIT_CH2_ONESHOT 0xB0        // Channel 2, lo/hi byte, mode 0
+
+// Port B: channel 2 gate, speaker enable and channel 2 output
+#define PIT_PORT_B 0x61
+#define PIT_GATE2 0x01
+#define PIT_SPEAKER 0x02
+#define PIT_OUT2 0x20
+
+// Calibration window: PIT counts for about 10 ms
+#define TIMER_CALIBRATE_COUNT (PIT_FREQUENCY / 100)
+
+// Timer wheel: level 0 has one slot per tick, each level above covers
+// TIMER_WHEEL_SIZE slots of the one below. Timers are hashed into the
+// slot of their expiry tick on the lowest level whose range reaches it
+// and move down a level when the wheel below wraps around.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+
+// Ticks the whole wheel reaches (about 4.6 hours at 1 kHz); later
+// timers wait in the last slot that far out and are rehashed from there
+#define TIMER_WHEEL_RANGE (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+#define CPUID_TSC (1u << 4)
+#define EFLAGS_IF (1u << 9)
+
+vic_uint32 timer_khz = 0;           // TSC kHz, 0 when ticks are the clock
+vic_uint64 timer_tsc_base = 0;
+vic_uint64 timer_ns_mult = 0;       // ns = (cycles * mult) >> 32
+volatile vic_uint64 timer_ticks = 0;
+vic_uint32 timer_pending = 0;       // Armed timers
+
+Timer* timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+vic_uint64 timer_wheel_next = 0;    // Next tick the wheel runs
+
+// Tickless idle: the periodic tick is stopped while halted and the tick
+// count is caught up from the TSC on wakeup
+bool timer_tickless = false;
+vic_uint64 timer_idle_total = 0;    // ns spent halted in timer_idle
+vic_uint32 timer_idle_wakeups = 0;
+
+static inline vic_uint64 timer_rdtsc() {
+    vic_uint32 lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((vic_uint64)hi << 32) | lo;
+}
+
+// (value * mult) >> 32 from 32-bit halves, so nothing overflows
+static vic_uint64 timer_scale(vic_uint64 value, vic_uint64 mult) {
+    vic_uint64 v_hi = value >> 32, v_lo = value & 0xFFFFFFFF;
+    vic_uint64 m_hi = mult >> 32, m_lo = mult & 0xFFFFFFFF;
+    return ((v_hi * m_hi) << 32) + v_hi * m_lo + v_lo * m_hi + ((v_lo * m_lo) >> 32);
+}
+
+static bool timer_irqs_enabled() {
+    vic_uint32 flags;
+    asm volatile ("pushf; pop %0" : "=r"(flags));
+    return flags & EFLAGS_IF;
+}
+
+// Count TSC cycles over TIMER_CALIBRATE_COUNT PIT periods on channel 2
+static vic_uint64 timer_calibrate() {
+    outb(PIT_PORT_B, (inb(PIT_PORT_B) & ~PIT_SPEAKER) | PIT_GATE2);
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, TIMER_CALIBRATE_COUNT & 0xFF);
+    outb(PIT_CHANNEL2, TIMER_CALIBRATE_COUNT >> 8);
+
+    vic_uint64 start = timer_rdtsc();
+    while (!(inb(PIT_PORT_B) & PIT_OUT2)) {
+    }
+    return timer_rdtsc() - start;
+}
+
+static void timer_list_add(Timer** head, Timer* timer) {
+    timer->next = *head;
+    timer->pprev = head;
+    if (*head) {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+}
+
+static void timer_list_del(Timer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = nullptr;
+    timer->pprev = nullptr;
+}
+
+static void timer_insert(Timer* timer) {
+    vic_uint64 expires = timer->expires;
+    if (expires < timer_wheel_next) {
+        expires = timer_wheel_next;
+    }
+
+    vic_uint64 delta = expires - timer_wheel_next;
+    if (delta >= TIMER_WHEEL_RANGE) {
+        delta = TIMER_WHEEL_RANGE - 1;
+        expires = timer_wheel_next + delta;
+    }
+
+    int level = 0;
+    while (delta >> (TIMER_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    vic_uint32 slot = (vic_uint32)(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+    if (!timer->armed) {
+        timer_pending++;
+    }
+    timer_list_add(&timer_wheel[level][slot], timer);
+    timer->armed = true;
+}
+
+static void timer_remove(Timer* timer) {
+    timer_list_del(timer);
+    timer->armed = false;
+    timer_pending--;
+}
+
+// Rehash one slot into the levels below; returns the slot index
+static vic_uint32 timer_cascade(int level, vic_uint32 slot) {
+    Timer* list = timer_wheel[level][slot];
+    timer_wheel[level][slot] = nullptr;
+
+    while (list) {
+        Timer* timer = list;
+        list = timer->next;
+        timer_insert(timer);
+    }
+    return slot;
+}
+
+// Run the timers due on tick, the next one the wheel has not run
+static void timer_run_tick(vic_uint64 tick) {
+    vic_uint32 slot = (vic_uint32)tick & TIMER_WHEEL_MASK;
+
+    // Level 0 wrapped: pull the next slot of each level above down
+    if (slot == 0) {
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            vic_uint32 index = (vic_uint32)(tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+            if (timer_cascade(level, index) != 0) {
+                break;
+            }
+        }
+    }
+
+    // Detach the due list first; callbacks may arm or cancel any timer,
+    // including ones still on it
+    Timer* due = nullptr;
+    Timer** head = &timer_wheel[0][slot];
+    if (*head) {
+        due = *head;
+        due->pprev = &due;
+        *head = nullptr;
+    }
+    timer_wheel_next = tick + 1;
+
+    while (due) {
+        Timer* timer = due;
+        timer_remove(timer);
+
+        // Periodic timers are re-armed first so the callback may cancel them
+        if (timer->period) {
+            do {
+                timer->expires += timer->period;
+            } while (timer->expires <= tick);
+            timer_insert(timer);
+        }
+        timer->callback(timer->data);
+    }
+}
+
+// Bring the tick count up to date and run every tick the wheel missed
+static void timer_advance() {
+    if (timer_tickless) {
+        vic_uint64 now = ktime_ns() / TIMER_TICK_NS;
+        if (now > timer_ticks) {
+            timer_ticks = now;
+        }
+    }
+
+    // An empty wheel has nothing to catch up on
+    if (timer_pending == 0) {
+        timer_wheel_next = timer_ticks + 1;
+        return;
+    }
+    while (timer_wheel_next <= timer_ticks) {
+        timer_run_tick(timer_wheel_next);
+    }
+}
+
+static void timer_tick() {
+    if (!timer_tickless) {
+        timer_ticks++;
+    }
+    timer_advance();
+}
+
+// Earliest tick any armed timer can fire on, or ~0 with none armed. For
+// the upper levels this is when their next busy slot cascades, which is
+// never after the timers in it expire.
+static vic_uint64 timer_next_expiry() {
+    if (timer_pending == 0) {
+        return ~0ull;
+    }
+
+    vic_uint64 next = ~0ull;
+    for (vic_uint32 k = 0; k < TIMER_WHEEL_SIZE; k++) {
+        vic_uint64 tick = timer_wheel_next + k;
+        if (timer_wheel[0][(vic_uint32)tick & TIMER_WHEEL_MASK]) {
+            next = tick;
+            break;
+        }
+    }
+
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        vic_uint64 span = 1ull << (TIMER_WHEEL_BITS * level);
+        vic_uint64 tick = (timer_wheel_next + span - 1) & ~(span - 1);
+        for (vic_uint32 k = 0; k < TIMER_WHEEL_SIZE && tick < next; k++, tick += span) {
+            vic_uint32 slot = (vic_uint32)(tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+            if (timer_wheel[level][slot]) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+static void timer_pit_periodic() {
+    outb(PIT_COMMAND, PIT_CH0_RATE);
+    outb(PIT_CHANNEL0, PIT_TICK_COUNT & 0xFF);
+    outb(PIT_CHANNEL0, PIT_TICK_COUNT >> 8);
+}
+
+// Replace the periodic tick with one interrupt at the next deadline, as
+// far as the PIT counter reaches, or none at all with no timer armed
+static void timer_pit_deadline() {
+    vic_uint64 next = timer_next_expiry();
+    if (next == ~0ull) {
+        // Mode 0 waits for a count that never comes
+        outb(PIT_COMMAND, PIT_CH0_ONESHOT);
+        return;
+    }
+
+    vic_uint64 now = timer_ticks;
+    vic_uint64 ticks = (next > now) ? next - now : 1;
+    vic_uint32 count = PIT_MAX_COUNT;
+    if (ticks < PIT_MAX_COUNT / PIT_TICK_COUNT) {
+        count = (vic_uint32)ticks * PIT_TICK_COUNT;
+    }
+    outb(PIT_COMMAND, PIT_CH0_ONESHOT);
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, count >> 8);
+}
+
+// Whole ticks in ns, rounded up
+static vic_uint64 timer_ns_to_ticks(vic_uint64 ns) {
+    return (ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+}
+
+void timer_init() {
+    vic_uint32 a, b, c, d;
+    asm volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(1), "c"(0));
+
+    if (d & CPUID_TSC) {
+        vic_uint64 cycles = timer_calibrate();
+        timer_khz = (vic_uint32)(cycles * PIT_FREQUENCY / (TIMER_CALIBRATE_COUNT * 1000));
+    }
+    if (timer_khz) {
+        timer_ns_mult = (1000000ull << 32) / timer_khz;
+        timer_tsc_base = timer_rdtsc();
+    }
+
+    // Periodic tick on channel 0. Without a TSC the tick is the clock,
+    // so it has to keep running through idle.
+    timer_tickless = (timer_khz != 0);
+    timer_pit_periodic();
+    irq_register(IRQ_TIMER, timer_tick);
+
+    kprint("Timer: ");
+    if (timer_khz) {
+        kprint("TSC ");
+        print_number(timer_khz / 1000);
+        kprint(" MHz, ");
+    }
+    kprint("PIT tick ");
+    print_number(TIMER_HZ);
+    kprint(timer_tickless ? " Hz, tickless idle\n" : " Hz\n");
+}
+
+vic_uint64 ktime_ns() {
+    if (timer_khz) {
+        return timer_scale(timer_rdtsc() - timer_tsc_base, timer_ns_mult);
+    }
+
+    // The tick count is 64 bits; read it in one piece
+    bool enabled = timer_irqs_enabled();
+    asm volatile ("cli" : : : "memory");
+    vic_uint64 ticks = timer_ticks;
+    if (enabled) {
+        asm volatile ("sti" : : : "memory");
+    }
+    return ticks * TIMER_TICK_NS;
+}
+
+void sleep_ns(vic_uint64 ns) {
+    // Other threads get the CPU meanwhile
+    if (sched_running() && timer_irqs_enabled()) {
+        sched_sleep_ns(ns);
+        return;
+    }
+
+    vic_uint64 deadline = ktime_ns() + ns;
+
+    // Halt through whole ticks when something will wake us
+    if (timer_irqs_enabled()) {
+        while (deadline > ktime_ns() + TIMER_TICK_NS) {
+            asm volatile ("hlt");
+        }
+    }
+
+    while (ktime_ns() < deadline) {
+        asm volatile ("pause");
+    }
+}
+
+void timer_start(Timer* timer, vic_uint64 delay_ns, vic_uint64 period_ns,
+                 TimerCallback callback, void* data) {
+    bool enabled = timer_irqs_enabled();
+    asm volatile ("cli" : : : "memory");
+
+    if (timer->armed) {
+        timer_remove(timer);
+    }
+
+    // One tick more, so a tick already under way does not count
+    timer->expires = timer_ticks + timer_ns_to_ticks(delay_ns) + 1;
+    timer->period = (vic_uint32)timer_ns_to_ticks(period_ns);
+    timer->callback = callback;
+    timer->data = data;
+    timer_insert(timer);
+
+    if (enabled) {
+        asm volatile ("sti" : : : "memory");
+    }
+}
+
+void timer_cancel(Timer* timer) {
+    bool enabled = timer_irqs_enabled();
+    asm volatile ("cli" : : : "memory");
+
+    if (timer->armed) {
+        timer_remove(timer);
+    }
+
+    if (enabled) {
+        asm volatile ("sti" : : : "memory");
+    }
+}
+
+vic_uint32 timer_tsc_khz() {
+    return timer_khz;
+}
+
+void timer_idle(bool (*ready)()) {
+    asm volatile ("cli" : : : "memory");
+
+    // Run anything already due first; it may be what ready() waits for
+    if (timer_tickless) {
+        timer_advance();
+    }
+    if (ready && ready()) {
+        asm volatile ("sti" : : : "memory");
+        return;
+    }
+
+    if (timer_tickless) {
+        timer_pit_deadline();
+    }
+    vic_uint64 start = ktime_ns();
+
+    // sti takes effect after the next instruction, so no interrupt can be
+    // taken between it and hlt. Whatever woke us has run once hlt returns.
+    asm volatile ("sti; hlt; cli" : : : "memory");
+
+    timer_idle_total += ktime_ns() - start;
+    timer_idle_wakeups++;
+    if (timer_tickless) {
+        timer_pit_periodic();
+        timer_advance();
+    }
+    asm volatile ("sti" : : : "memory");
+}
+
+vic_uint64 timer_idle_ns() {
+    return timer_idle_total;
+}
+
+// Print a duration in seconds as H:MM:SS
+static void timer_print_duration(vic_uint32 seconds) {
+    print_number(seconds / 3600);
+    kprint(seconds % 3600 < 600 ? ":0" : ":");
+    print_number(seconds % 3600 / 60);
+    kprint(seconds % 60 < 10 ? ":0" : ":");
+    print_number(seconds % 60);
+}
+
+// Process uptime command
+void process_uptime(const char* /* command */) {
+    vic_uint64 up = ktime_ns();
+    vic_uint64 idle = timer_idle_total;
+
+    kprint("Up ");
+    timer_print_duration((vic_uint32)(up / TIMER_NS_PER_SEC));
+    kprint(", idle ");
+    timer_print_duration((vic_uint32)(idle / TIMER_NS_PER_SEC));
+
+    kprint(" (");
+    print_number(up ? (vic_uint32)(idle * 100 / up) : 0);
+    kprint("%)\n");
+
+    kprint("Wakeups from idle: ");
+    print_number(timer_idle_wakeups);
+    kprint(", timer interrupts: ");
+    print_number(irq_count(IRQ_TIMER));
+    kprint(timer_tickless ? " (tickless)\n" : "\n");
+}
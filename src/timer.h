@@ -0,0 +1,64 @@
+// src/timer.h
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+#define TIMER_NS_PER_US 1000ull
+#define TIMER_NS_PER_MS 1000000ull
+#define TIMER_NS_PER_SEC 1000000000ull
+
+// Rate of the PIT tick that drives timer callbacks. Timers fire on
+// tick boundaries, so this is also their resolution.
+#define TIMER_HZ 1000
+#define TIMER_TICK_NS (TIMER_NS_PER_SEC / TIMER_HZ)
+
+// Runs in interrupt context
+typedef void (*TimerCallback)(void* data);
+
+// Owned by the caller; must stay valid while armed
+struct Timer {
+    vic_uint64 expires;         // Tick to fire on
+    vic_uint32 period;          // Ticks between runs, 0 for one-shot
+    TimerCallback callback;
+    void* data;
+    Timer* next;                // Timer wheel slot list
+    Timer** pprev;
+    bool armed;
+};
+
+// Calibrate the TSC against the PIT and start the tick on IRQ 0.
+// Call after interrupts_init.
+void timer_init();
+
+// Nanoseconds since timer_init, monotonic. Uses the TSC when there is
+// one, the tick count otherwise.
+vic_uint64 ktime_ns();
+
+// Wait at least ns nanoseconds. Once threads run the caller blocks on a
+// timer; before that whole ticks are slept in hlt and the rest is spun
+// out on the clock.
+void sleep_ns(vic_uint64 ns);
+
+// Arm timer to call callback(data) after delay_ns, then every period_ns
+// if that is not 0. Both round up to whole ticks. Re-arming an armed
+// timer moves it. Arming and cancelling are O(1).
+void timer_start(Timer* timer, vic_uint64 delay_ns, vic_uint64 period_ns,
+                 TimerCallback callback, void* data);
+void timer_cancel(Timer* timer);
+
+// Halt until the next interrupt unless ready() already holds. Checking and
+// halting happen with interrupts off, so a wakeup cannot slip in between.
+// With a TSC the periodic tick is stopped meanwhile and the PIT fires once
+// at the next timer deadline instead. Time spent here counts as idle.
+void timer_idle(bool (*ready)());
+
+// Total time spent in timer_idle
+vic_uint64 timer_idle_ns();
+
+// TSC rate found at boot, 0 without a TSC
+vic_uint32 timer_tsc_khz();
+
+#endif // TIMER_H
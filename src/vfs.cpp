@@ -0,0 +1,1001 @@
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+#include "vfs.h"
+#include "page_cache.h"
+#include "sched.h"
+
+// Forward declaration from fs_log.cpp
+int fs_log_commit();
+
+// Mount table, vnode cache and open-file table
+VfsMount vfs_mounts[VFS_MAX_MOUNTS];
+VNode vfs_vnodes[VFS_MAX_VNODES];
+VfsFile vfs_files[VFS_MAX_OPEN_FILES];
+
+// Current working directory (canonical absolute path)
+char vfs_cwd[VFS_MAX_PATH] = "/";
+vic_size_t vfs_cwd_len = 1;
+
+// Next vnode slot to consider when the cache is full
+vic_uint32 vfs_vnode_hand = 0;
+
+// Bounce buffer for copies between different filesystems
+char vfs_copy_buf[PAGE_CACHE_PAGE_SIZE];
+
+// Held by whichever thread is using the filesystem
+Mutex vfs_mutex;
+
+// How often the writeback thread flushes the page cache
+#define VFS_WRITEBACK_NS (5 * TIMER_NS_PER_SEC)
+
+// Largest file vfs_stream serves through the page cache
+#define VFS_STREAM_CACHE_LIMIT (page_cache_size() * PAGE_CACHE_PAGE_SIZE / 2)
+
+// Relative path of a mount's own root
+static const char vfs_root_path[] = "/";
+
+// String operations
+static vic_size_t vfs_strlen(const char* str) {
+    vic_size_t len = 0;
+    while (str[len]) {
+        len++;
+    }
+    return len;
+}
+
+static bool vfs_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *s1 == *s2;
+}
+
+static void vfs_strcpy(char* dest, const char* src) {
+    while (*src) {
+        *dest++ = *src++;
+    }
+    *dest = '\0';
+}
+
+// Normalise a path against the cwd into canonical absolute form:
+// no ".", "..", repeated or trailing slashes
+int vfs_normalize(const char* path, char* out) {
+    if (!path || !*path) {
+        return VFS_ERR_INVALID;
+    }
+
+    vic_size_t len;
+    if (path[0] == '/') {
+        out[0] = '/';
+        len = 1;
+    } else {
+        len = vfs_cwd_len;
+        for (vic_size_t i = 0; i < len; i++) {
+            out[i] = vfs_cwd[i];
+        }
+    }
+
+    const char* ptr = path;
+    while (*ptr) {
+        // Skip separators
+        while (*ptr == '/') {
+            ptr++;
+        }
+        if (!*ptr) {
+            break;
+        }
+
+        // Find the end of this component
+        const char* start = ptr;
+        while (*ptr && *ptr != '/') {
+            ptr++;
+        }
+        vic_size_t comp_len = ptr - start;
+
+        // "." stays where we are
+        if (comp_len == 1 && start[0] == '.') {
+            continue;
+        }
+
+        // ".." drops the last component (root is its own parent)
+        if (comp_len == 2 && start[0] == '.' && start[1] == '.') {
+            while (len > 1 && out[len - 1] != '/') {
+                len--;
+            }
+            if (len > 1) {
+                len--;
+            }
+            continue;
+        }
+
+        if (comp_len >= VFS_MAX_NAME) {
+            return VFS_ERR_INVALID;
+        }
+
+        // Append "/component"
+        vic_size_t needed = len + comp_len + (len > 1 ? 1 : 0);
+        if (needed >= VFS_MAX_PATH) {
+            return VFS_ERR_INVALID;
+        }
+        if (len > 1) {
+            out[len++] = '/';
+        }
+        for (vic_size_t i = 0; i < comp_len; i++) {
+            out[len++] = start[i];
+        }
+    }
+
+    out[len] = '\0';
+    return VFS_OK;
+}
+
+// Find the mount owning a canonical path (longest prefix wins)
+// Sets rel to the path inside that mount
+static VfsMount* vfs_find_mount(const char* path, const char** rel) {
+    VfsMount* best = nullptr;
+
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        VfsMount* mnt = &vfs_mounts[i];
+        if (!mnt->used) {
+            continue;
+        }
+
+        bool matches;
+        if (mnt->path_len == 1) {
+            matches = true; // Root mount covers everything
+        } else {
+            matches = true;
+            for (vic_size_t j = 0; j < mnt->path_len; j++) {
+                if (path[j] != mnt->path[j]) {
+                    matches = false;
+                    break;
+                }
+            }
+            if (matches && path[mnt->path_len] != '\0' && path[mnt->path_len] != '/') {
+                matches = false; // "/diskette" is not under "/disk"
+            }
+        }
+
+        if (matches && (!best || mnt->path_len > best->path_len)) {
+            best = mnt;
+        }
+    }
+
+    if (best) {
+        if (best->path_len == 1) {
+            *rel = path;
+        } else if (path[best->path_len] == '\0') {
+            *rel = vfs_root_path;
+        } else {
+            *rel = path + best->path_len;
+        }
+    }
+
+    return best;
+}
+
+// Drop a cached vnode, letting the backend release its state
+// A vnode whose dirty pages fail to write back stays cached with them
+// Returns VFS_OK, or the writeback error
+static int vfs_evict_vnode(VNode* node) {
+    int result = page_cache_flush(node);
+    if (result < 0) {
+        return result;
+    }
+    page_cache_invalidate(node);
+    if (node->mount->ops->release) {
+        node->mount->ops->release(node);
+    }
+    node->used = false;
+    return VFS_OK;
+}
+
+// Take a vnode slot, evicting an unreferenced cached vnode if needed
+// Returns VFS_OK, or the writeback error if every candidate failed to flush
+static int vfs_alloc_vnode(VNode** out) {
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (!vfs_vnodes[i].used) {
+            *out = &vfs_vnodes[i];
+            return VFS_OK;
+        }
+    }
+
+    // Cache full: round-robin over vnodes nobody has open
+    int status = VFS_ERR_TOO_MANY;
+    for (vic_uint32 n = 0; n < VFS_MAX_VNODES; n++) {
+        VNode* node = &vfs_vnodes[vfs_vnode_hand];
+        vfs_vnode_hand = (vfs_vnode_hand + 1) % VFS_MAX_VNODES;
+
+        if (node->refcount == 0) {
+            int result = vfs_evict_vnode(node);
+            if (result == VFS_OK) {
+                *out = node;
+                return VFS_OK;
+            }
+            status = result;
+        }
+    }
+
+    return status;
+}
+
+// Look up a cached vnode by mount and relative path
+static VNode* vfs_cached_vnode(VfsMount* mnt, const char* rel) {
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (vfs_vnodes[i].used &&
+            vfs_vnodes[i].mount == mnt &&
+            vfs_strcmp(vfs_vnodes[i].path, rel)) {
+            return &vfs_vnodes[i];
+        }
+    }
+    return nullptr;
+}
+
+// Resolve a canonical path to a vnode, optionally creating a regular file
+static int vfs_get_vnode(const char* canonical, bool create, VNode** out) {
+    const char* rel;
+    VfsMount* mnt = vfs_find_mount(canonical, &rel);
+    if (!mnt) {
+        return VFS_ERR_NOT_FOUND;
+    }
+
+    VNode* node = vfs_cached_vnode(mnt, rel);
+    if (node) {
+        *out = node;
+        return VFS_OK;
+    }
+
+    int result = vfs_alloc_vnode(&node);
+    if (result < 0) {
+        return result;
+    }
+
+    node->mount = mnt;
+    vfs_strcpy(node->path, rel);
+    node->type = 0;
+    node->size = 0;
+    node->ino = 0;
+    node->refcount = 0;
+    node->priv = nullptr;
+
+    result = mnt->ops->lookup(mnt, rel, node);
+    if (result == VFS_ERR_NOT_FOUND && create) {
+        result = mnt->ops->create(mnt, rel, node);
+    }
+    if (result < 0) {
+        return result;
+    }
+
+    node->used = true;
+    *out = node;
+    return VFS_OK;
+}
+
+// Validate a descriptor
+static VfsFile* vfs_get_file(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_OPEN_FILES || !vfs_files[fd].used) {
+        return nullptr;
+    }
+    return &vfs_files[fd];
+}
+
+// Initialize the VFS tables
+void vfs_init() {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        vfs_mounts[i].used = false;
+    }
+    for (int i = 0; i < VFS_MAX_VNODES; i++) {
+        vfs_vnodes[i].used = false;
+    }
+    for (int i = 0; i < VFS_MAX_OPEN_FILES; i++) {
+        vfs_files[i].used = false;
+    }
+    vfs_strcpy(vfs_cwd, "/");
+    vfs_cwd_len = 1;
+    page_cache_init();
+}
+
+// Mount a filesystem at path
+// Anything but the root mount needs an existing directory to cover
+int vfs_mount(const char* path, const VfsOps* ops) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    if (vfs_is_mounted(canonical)) {
+        return VFS_ERR_BUSY;
+    }
+
+    bool is_root = canonical[1] == '\0';
+    if (!is_root) {
+        VfsDirEntry info;
+        result = vfs_stat(canonical, &info);
+        if (result < 0) {
+            return result;
+        }
+        if (info.type != VFS_TYPE_DIRECTORY) {
+            return VFS_ERR_NOT_DIR;
+        }
+    }
+
+    VfsMount* mnt = nullptr;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (!vfs_mounts[i].used) {
+            mnt = &vfs_mounts[i];
+            break;
+        }
+    }
+    if (!mnt) {
+        return VFS_ERR_TOO_MANY;
+    }
+
+    vfs_strcpy(mnt->path, canonical);
+    mnt->path_len = vfs_strlen(canonical);
+    mnt->ops = ops;
+    mnt->priv = nullptr;
+
+    if (ops->mount) {
+        result = ops->mount(mnt);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    // The covered directory's vnode now resolves into the new mount
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        VNode* node = &vfs_vnodes[i];
+        if (node->used && node->refcount == 0 && node->mount != mnt) {
+            vfs_evict_vnode(node);
+        }
+    }
+
+    mnt->used = true;
+    return VFS_OK;
+}
+
+// Unmount the filesystem mounted exactly at path
+int vfs_unmount(const char* path) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    VfsMount* mnt = nullptr;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (vfs_mounts[i].used && vfs_strcmp(vfs_mounts[i].path, canonical)) {
+            mnt = &vfs_mounts[i];
+            break;
+        }
+    }
+    if (!mnt) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (mnt->path_len == 1) {
+        return VFS_ERR_BUSY; // The root filesystem stays
+    }
+
+    // Refuse while files are open on it
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (vfs_vnodes[i].used && vfs_vnodes[i].mount == mnt && vfs_vnodes[i].refcount > 0) {
+            return VFS_ERR_BUSY;
+        }
+    }
+
+    // Keep the mount if its data can't be written back
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (vfs_vnodes[i].used && vfs_vnodes[i].mount == mnt) {
+            result = vfs_evict_vnode(&vfs_vnodes[i]);
+            if (result < 0) {
+                return result;
+            }
+        }
+    }
+
+    if (mnt->ops->unmount) {
+        mnt->ops->unmount(mnt);
+    }
+    mnt->used = false;
+
+    // Leave the unmounted tree if we were inside it
+    bool inside = true;
+    for (vic_size_t i = 0; i < mnt->path_len; i++) {
+        if (vfs_cwd[i] != canonical[i]) {
+            inside = false;
+            break;
+        }
+    }
+    if (inside && (vfs_cwd[mnt->path_len] == '\0' || vfs_cwd[mnt->path_len] == '/')) {
+        vfs_strcpy(vfs_cwd, "/");
+        vfs_cwd_len = 1;
+    }
+
+    return VFS_OK;
+}
+
+// Check whether path is exactly a mount point
+bool vfs_is_mounted(const char* path) {
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (vfs_mounts[i].used && vfs_strcmp(vfs_mounts[i].path, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Access the mount table (for listing)
+const VfsMount* vfs_get_mount(int index) {
+    if (index < 0 || index >= VFS_MAX_MOUNTS || !vfs_mounts[index].used) {
+        return nullptr;
+    }
+    return &vfs_mounts[index];
+}
+
+// Get the backend serving path
+const VfsOps* vfs_get_ops(const char* path) {
+    char canonical[VFS_MAX_PATH];
+    if (vfs_normalize(path, canonical) < 0) {
+        return nullptr;
+    }
+
+    const char* rel;
+    VfsMount* mnt = vfs_find_mount(canonical, &rel);
+    return mnt ? mnt->ops : nullptr;
+}
+
+// Drop every cached vnode of the mount serving path, for backends whose
+// tree was replaced underneath the VFS
+int vfs_drop_cache(const char* path) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    const char* rel;
+    VfsMount* mnt = vfs_find_mount(canonical, &rel);
+    if (!mnt) {
+        return VFS_ERR_NOT_FOUND;
+    }
+
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (vfs_vnodes[i].used && vfs_vnodes[i].mount == mnt && vfs_vnodes[i].refcount > 0) {
+            return VFS_ERR_BUSY;
+        }
+    }
+    for (vic_uint32 i = 0; i < VFS_MAX_VNODES; i++) {
+        if (vfs_vnodes[i].used && vfs_vnodes[i].mount == mnt) {
+            page_cache_invalidate(&vfs_vnodes[i]);
+            if (mnt->ops->release) {
+                mnt->ops->release(&vfs_vnodes[i]);
+            }
+            vfs_vnodes[i].used = false;
+        }
+    }
+    return VFS_OK;
+}
+
+// Write back every dirty cached page
+int vfs_sync() {
+    return page_cache_flush(nullptr);
+}
+
+void vfs_lock() {
+    if (sched_running()) {
+        mutex_lock(&vfs_mutex);
+    }
+}
+
+void vfs_unlock() {
+    if (sched_running()) {
+        mutex_unlock(&vfs_mutex);
+    }
+}
+
+static void vfs_writeback(void* /* arg */) {
+    for (;;) {
+        sched_sleep_ns(VFS_WRITEBACK_NS);
+        vfs_lock();
+        vfs_sync();
+        // The flush fed the RAM FS log; make those records durable too
+        fs_log_commit();
+        vfs_unlock();
+    }
+}
+
+void vfs_start_writeback() {
+    thread_create("writeback", vfs_writeback, nullptr, SCHED_PRIORITY_LOW);
+}
+
+// Check that a canonical path names a directory
+static int vfs_check_dir(const char* canonical) {
+    VNode* node;
+    int result = vfs_get_vnode(canonical, false, &node);
+    if (result < 0) {
+        return result;
+    }
+    return (node->type == VFS_TYPE_DIRECTORY) ? VFS_OK : VFS_ERR_NOT_DIR;
+}
+
+// Change the current working directory
+int vfs_chdir(const char* path) {
+    if (!path || !*path) {
+        return VFS_ERR_INVALID;
+    }
+
+    // "cd name" and "cd .." edit the cwd in place: append one component
+    // or move the terminator back, restoring it if the target is no good
+    vic_size_t len = 0;
+    bool simple = !(path[0] == '.' && path[1] == '\0');
+    while (path[len]) {
+        if (path[len] == '/') {
+            simple = false;
+        }
+        len++;
+    }
+    if (simple) {
+        vic_size_t old_len = vfs_cwd_len;
+        vic_size_t new_len = old_len;
+        if (len == 2 && path[0] == '.' && path[1] == '.') {
+            while (new_len > 1 && vfs_cwd[new_len - 1] != '/') {
+                new_len--;
+            }
+            if (new_len > 1) {
+                new_len--;
+            }
+        } else {
+            if (len >= VFS_MAX_NAME || old_len + len + (old_len > 1 ? 1 : 0) >= VFS_MAX_PATH) {
+                return VFS_ERR_INVALID;
+            }
+            if (new_len > 1) {
+                vfs_cwd[new_len++] = '/';
+            }
+            for (vic_size_t i = 0; i < len; i++) {
+                vfs_cwd[new_len++] = path[i];
+            }
+        }
+
+        char saved = vfs_cwd[new_len];
+        vfs_cwd[new_len] = '\0';
+        int result = vfs_check_dir(vfs_cwd);
+        if (result < 0) {
+            vfs_cwd[new_len] = saved;
+            vfs_cwd[old_len] = '\0';
+            return result;
+        }
+        vfs_cwd_len = new_len;
+        return VFS_OK;
+    }
+
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+    result = vfs_check_dir(canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    vfs_strcpy(vfs_cwd, canonical);
+    vfs_cwd_len = vfs_strlen(canonical);
+    return VFS_OK;
+}
+
+// Get the current working directory
+const char* vfs_getcwd() {
+    return vfs_cwd;
+}
+
+// Get type and size of a path
+int vfs_stat(const char* path, VfsDirEntry* info) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    VNode* node;
+    result = vfs_get_vnode(canonical, false, &node);
+    if (result < 0) {
+        return result;
+    }
+
+    // Name is the last component of the canonical path
+    const char* name = canonical;
+    for (const char* ptr = canonical; *ptr; ptr++) {
+        if (*ptr == '/' && ptr[1]) {
+            name = ptr + 1;
+        }
+    }
+    vfs_strcpy(info->name, name);
+    info->type = node->type;
+    info->size = node->size;
+
+    return VFS_OK;
+}
+
+// Create a directory
+int vfs_mkdir(const char* path) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    const char* rel;
+    VfsMount* mnt = vfs_find_mount(canonical, &rel);
+    if (!mnt) {
+        return VFS_ERR_NOT_FOUND;
+    }
+    if (rel[1] == '\0' || vfs_cached_vnode(mnt, rel)) {
+        return VFS_ERR_EXISTS;
+    }
+    if (!mnt->ops->mkdir) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+
+    return mnt->ops->mkdir(mnt, rel);
+}
+
+// Delete a node of the given type
+static int vfs_remove(const char* path, vic_uint8 type) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    // Mount points and the directories holding the cwd stay
+    vic_size_t len = vfs_strlen(canonical);
+    bool holds_cwd = true;
+    for (vic_size_t i = 0; i < len; i++) {
+        if (vfs_cwd[i] != canonical[i]) {
+            holds_cwd = false;
+            break;
+        }
+    }
+    if (vfs_is_mounted(canonical) ||
+        (holds_cwd && (vfs_cwd[len] == '\0' || vfs_cwd[len] == '/'))) {
+        return VFS_ERR_BUSY;
+    }
+
+    VNode* node;
+    result = vfs_get_vnode(canonical, false, &node);
+    if (result < 0) {
+        return result;
+    }
+    if (node->type != type) {
+        return (type == VFS_TYPE_DIRECTORY) ? VFS_ERR_NOT_DIR : VFS_ERR_IS_DIR;
+    }
+    if (node->refcount > 0) {
+        return VFS_ERR_BUSY;
+    }
+
+    VfsMount* mnt = node->mount;
+    if (!mnt->ops->remove) {
+        return VFS_ERR_NOT_SUPPORTED;
+    }
+
+    // Drop the vnode first; its cached data is about to become garbage
+    page_cache_invalidate(node);
+    if (mnt->ops->release) {
+        mnt->ops->release(node);
+    }
+    node->used = false;
+
+    const char* rel;
+    vfs_find_mount(canonical, &rel);
+    return mnt->ops->remove(mnt, rel);
+}
+
+// Delete a file
+int vfs_unlink(const char* path) {
+    return vfs_remove(path, VFS_TYPE_FILE);
+}
+
+// Delete an empty directory
+int vfs_rmdir(const char* path) {
+    return vfs_remove(path, VFS_TYPE_DIRECTORY);
+}
+
+// Open a file (or a directory with VFS_O_DIRECTORY)
+// Returns a descriptor, or a negative VFS error
+int vfs_open(const char* path, int flags) {
+    char canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(path, canonical);
+    if (result < 0) {
+        return result;
+    }
+
+    int fd = -1;
+    for (int i = 0; i < VFS_MAX_OPEN_FILES; i++) {
+        if (!vfs_files[i].used) {
+            fd = i;
+            break;
+        }
+    }
+    if (fd < 0) {
+        return VFS_ERR_TOO_MANY;
+    }
+
+    VNode* node;
+    bool create = (flags & VFS_O_CREATE) && !(flags & VFS_O_DIRECTORY);
+    result = vfs_get_vnode(canonical, create, &node);
+    if (result < 0) {
+        return result;
+    }
+
+    if (flags & VFS_O_DIRECTORY) {
+        if (node->type != VFS_TYPE_DIRECTORY) {
+            return VFS_ERR_NOT_DIR;
+        }
+    } else if (node->type == VFS_TYPE_DIRECTORY) {
+        return VFS_ERR_IS_DIR;
+    }
+
+    VfsFile* file = &vfs_files[fd];
+    file->node = node;
+    file->flags = flags;
+    file->offset = 0;
+    file->priv = nullptr;
+
+    if (flags & VFS_O_DIRECTORY) {
+        result = node->mount->ops->opendir(node, file);
+        if (result < 0) {
+            return result;
+        }
+    } else if ((flags & VFS_O_TRUNC) && (flags & VFS_O_WRITE) && node->size > 0) {
+        page_cache_invalidate(node);
+        result = node->mount->ops->truncate(node, 0);
+        if (result < 0) {
+            return result;
+        }
+        node->size = 0;
+    }
+
+    node->refcount++;
+    file->used = true;
+    return fd;
+}
+
+// Close a descriptor
+// The vnode stays cached; dirty pages are written back and backend file
+// state is released on last close. Returns a writeback error, if any.
+int vfs_close(int fd) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file) {
+        return VFS_ERR_INVALID;
+    }
+
+    VNode* node = file->node;
+    int result = VFS_OK;
+    if (file->flags & VFS_O_DIRECTORY) {
+        node->mount->ops->closedir(node, file);
+    }
+
+    node->refcount--;
+    if (node->refcount == 0) {
+        result = page_cache_flush(node);
+        if (result < 0) {
+            // Nobody is left to retry; don't let the pages pin the cache
+            page_cache_invalidate(node);
+        }
+        if (node->mount->ops->release) {
+            node->mount->ops->release(node);
+        }
+    }
+
+    file->used = false;
+    return result;
+}
+
+// Read from the current position
+// Returns bytes read (0 at end of file)
+int vfs_read(int fd, void* buf, vic_uint32 len) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || !(file->flags & VFS_O_READ) || (file->flags & VFS_O_DIRECTORY)) {
+        return VFS_ERR_INVALID;
+    }
+
+    VNode* node = file->node;
+    if (file->offset >= node->size) {
+        return 0;
+    }
+    if (len > node->size - file->offset) {
+        len = node->size - file->offset;
+    }
+
+    int count = page_cache_read(node, file->offset, buf, len);
+    if (count > 0) {
+        file->offset += count;
+    }
+    return count;
+}
+
+// Write at the current position, growing the file as needed
+// Returns bytes written
+int vfs_write(int fd, const void* buf, vic_uint32 len) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || !(file->flags & VFS_O_WRITE)) {
+        return VFS_ERR_INVALID;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    VNode* node = file->node;
+    if (file->flags & VFS_O_APPEND) {
+        file->offset = node->size;
+    }
+    int count = page_cache_write(node, file->offset, buf, len);
+    if (count < 0) {
+        return count;
+    }
+    if (count == 0) {
+        return VFS_ERR_NO_SPACE;
+    }
+
+    file->offset += count;
+    if (file->offset > node->size) {
+        node->size = file->offset;
+    }
+    return count;
+}
+
+// Move the file position
+int vfs_seek(int fd, vic_uint32 offset) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || (file->flags & VFS_O_DIRECTORY)) {
+        return VFS_ERR_INVALID;
+    }
+
+    file->offset = offset;
+    return VFS_OK;
+}
+
+// Size of an open file
+int vfs_size(int fd) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file) {
+        return VFS_ERR_INVALID;
+    }
+    return (int)file->node->size;
+}
+
+// Write back a file's cached pages and have the backend commit them
+int vfs_fsync(int fd) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || (file->flags & VFS_O_DIRECTORY)) {
+        return VFS_ERR_INVALID;
+    }
+
+    int result = page_cache_flush(file->node);
+    if (result >= 0 && file->node->mount->ops->sync) {
+        result = file->node->mount->ops->sync(file->node);
+    }
+    return result;
+}
+
+// Push the rest of a file to sink
+// Files that fit comfortably in the page cache are served from it. Larger
+// ones go through the backend's zero-copy stream, if it has one, so a
+// single big cat doesn't flush every hot page out of the cache.
+int vfs_stream(int fd, VfsSink sink) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || !(file->flags & VFS_O_READ) || (file->flags & VFS_O_DIRECTORY)) {
+        return VFS_ERR_INVALID;
+    }
+
+    VNode* node = file->node;
+    int count;
+    if (node->mount->ops->stream && node->size > VFS_STREAM_CACHE_LIMIT) {
+        count = page_cache_flush(node);
+        if (count == VFS_OK) {
+            count = node->mount->ops->stream(node, file->offset, sink);
+        }
+    } else {
+        count = page_cache_stream(node, file->offset, sink);
+    }
+
+    if (count > 0) {
+        file->offset += count;
+    }
+    return count;
+}
+
+// Copy a file. Within one filesystem whose backend can clone, dst just
+// shares src's data; otherwise the data goes through a bounce buffer.
+int vfs_copy(const char* src, const char* dst) {
+    char src_canonical[VFS_MAX_PATH];
+    char dst_canonical[VFS_MAX_PATH];
+    int result = vfs_normalize(src, src_canonical);
+    if (result >= 0) {
+        result = vfs_normalize(dst, dst_canonical);
+    }
+    if (result < 0) {
+        return result;
+    }
+    if (vfs_strcmp(src_canonical, dst_canonical)) {
+        return VFS_ERR_INVALID;
+    }
+
+    int in = vfs_open(src_canonical, VFS_O_READ);
+    if (in < 0) {
+        return in;
+    }
+    int out = vfs_open(dst_canonical, VFS_O_WRITE | VFS_O_CREATE | VFS_O_TRUNC);
+    if (out < 0) {
+        vfs_close(in);
+        return out;
+    }
+
+    VNode* from = vfs_files[in].node;
+    VNode* to = vfs_files[out].node;
+    if (from->mount == to->mount && from->mount->ops->clone) {
+        // The backend must see src's latest data and dst must lose its own
+        result = page_cache_flush(from);
+        if (result >= 0) {
+            page_cache_invalidate(to);
+            result = from->mount->ops->clone(from, to);
+        }
+        if (result >= 0) {
+            to->size = from->size;
+        }
+    } else {
+        for (;;) {
+            int count = vfs_read(in, vfs_copy_buf, sizeof(vfs_copy_buf));
+            if (count <= 0) {
+                result = count;
+                break;
+            }
+            int written = vfs_write(out, vfs_copy_buf, count);
+            if (written != count) {
+                result = (written < 0) ? written : VFS_ERR_NO_SPACE;
+                break;
+            }
+        }
+    }
+
+    vfs_close(in);
+    int closed = vfs_close(out);
+    return (result < 0) ? result : closed;
+}
+
+// Open a directory for vfs_readdir
+int vfs_opendir(const char* path) {
+    return vfs_open(path, VFS_O_READ | VFS_O_DIRECTORY);
+}
+
+// Read the next directory entry
+// Returns 1 with an entry, 0 at the end
+int vfs_readdir(int fd, VfsDirEntry* entry) {
+    VfsFile* file = vfs_get_file(fd);
+    if (!file || !(file->flags & VFS_O_DIRECTORY)) {
+        return VFS_ERR_INVALID;
+    }
+    return file->node->mount->ops->readdir(file->node, file, entry);
+}
+
+// Error text for a VFS result code
+const char* vfs_strerror(int err) {
+    switch (err) {
+        case VFS_OK:                return "Success";
+        case VFS_ERR_NOT_FOUND:     return "No such file or directory";
+        case VFS_ERR_EXISTS:        return "Already exists";
+        case VFS_ERR_NOT_DIR:       return "Not a directory";
+        case VFS_ERR_IS_DIR:        return "Is a directory";
+        case VFS_ERR_NO_SPACE:      return "No space left";
+        case VFS_ERR_IO:            return "I/O error";
+        case VFS_ERR_INVALID:       return "Invalid argument";
+        case VFS_ERR_BUSY:          return "Resource busy";
+        case VFS_ERR_NOT_SUPPORTED: return "Operation not supported";
+        case VFS_ERR_TOO_MANY:      return "Too many open files";
+        case VFS_ERR_NOT_EMPTY:     return "Directory not empty";
+        default:                    return "Unknown error";
+    }
+}
@@ -0,0 +1,164 @@
+// src/vfs.h
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include "vstdint.h"
+#include <stddef.h>
+
+// Maximum length of a full path, including the terminator
+#define VFS_MAX_PATH 256
+
+// Maximum length of one path component (FatFs LFN allows 255)
+#define VFS_MAX_NAME 256
+
+// Table sizes
+#define VFS_MAX_MOUNTS 4
+#define VFS_MAX_VNODES 32
+#define VFS_MAX_OPEN_FILES 16
+
+// Node types (same values as the RAM filesystem)
+#define VFS_TYPE_FILE 1
+#define VFS_TYPE_DIRECTORY 2
+
+// Open flags
+#define VFS_O_READ      0x01
+#define VFS_O_WRITE     0x02
+#define VFS_O_CREATE    0x04
+#define VFS_O_TRUNC     0x08
+#define VFS_O_DIRECTORY 0x10
+#define VFS_O_APPEND    0x20    // Every write goes to the end of the file
+
+// Result codes - every VFS call returns >= 0 on success
+#define VFS_OK                 0
+#define VFS_ERR_NOT_FOUND     -1
+#define VFS_ERR_EXISTS        -2
+#define VFS_ERR_NOT_DIR       -3
+#define VFS_ERR_IS_DIR        -4
+#define VFS_ERR_NO_SPACE      -5
+#define VFS_ERR_IO            -6
+#define VFS_ERR_INVALID       -7
+#define VFS_ERR_BUSY          -8
+#define VFS_ERR_NOT_SUPPORTED -9
+#define VFS_ERR_TOO_MANY      -10
+#define VFS_ERR_NOT_EMPTY     -11
+
+struct VfsOps;
+
+// One mounted filesystem
+struct VfsMount {
+    bool used;
+    char path[VFS_MAX_PATH];  // Canonical mount point, e.g. "/" or "/disk"
+    vic_size_t path_len;
+    const VfsOps* ops;
+    void* priv;               // Backend volume state
+};
+
+// In-core file or directory. Vnodes stay cached after their last close so
+// repeated lookups of hot paths skip the backend.
+struct VNode {
+    bool used;
+    VfsMount* mount;
+    char path[VFS_MAX_PATH];  // Canonical path relative to the mount ("/etc/motd")
+    vic_uint8 type;
+    vic_uint32 size;
+    vic_uint32 ino;           // Backend node id (RAM FS table index)
+    vic_uint32 refcount;      // Open files referencing this vnode
+    void* priv;               // Backend per-node state (FatFs FIL)
+};
+
+// Entry in the open-file table
+struct VfsFile {
+    bool used;
+    VNode* node;
+    int flags;
+    vic_uint32 offset;        // File position, or directory cursor
+    void* priv;               // Backend per-descriptor state (FatFs DIR)
+};
+
+// Directory entry returned by vfs_readdir
+struct VfsDirEntry {
+    char name[VFS_MAX_NAME];
+    vic_uint8 type;
+    vic_uint32 size;
+};
+
+// Receives file data pushed by vfs_stream
+typedef void (*VfsSink)(const char* data, vic_uint32 len);
+
+// Backend operations. Paths handed to a backend are relative to its mount
+// point, absolute and normalised ("/", "/etc/motd"). Optional entries may
+// be null.
+struct VfsOps {
+    const char* name;
+    int (*mount)(VfsMount* mnt);
+    int (*unmount)(VfsMount* mnt);
+    int (*lookup)(VfsMount* mnt, const char* path, VNode* node);
+    int (*create)(VfsMount* mnt, const char* path, VNode* node);
+    int (*mkdir)(VfsMount* mnt, const char* path);
+    int (*remove)(VfsMount* mnt, const char* path);                 // File or empty directory
+    int (*read)(VNode* node, vic_uint32 offset, void* buf, vic_uint32 len);
+    int (*write)(VNode* node, vic_uint32 offset, const void* buf, vic_uint32 len);
+    int (*truncate)(VNode* node, vic_uint32 size);
+    int (*opendir)(VNode* node, VfsFile* dir);
+    int (*readdir)(VNode* node, VfsFile* dir, VfsDirEntry* entry);  // 1 = entry, 0 = end
+    void (*closedir)(VNode* node, VfsFile* dir);
+    void (*release)(VNode* node);                                   // Optional
+    int (*stream)(VNode* node, vic_uint32 offset, VfsSink sink);    // Optional zero-copy read
+    int (*sync)(VNode* node);                                       // Optional: make writes durable
+    int (*clone)(VNode* src, VNode* dst);                           // Optional: dst shares src's data
+};
+
+// Filesystem backends
+extern const VfsOps ramfs_vfs_ops;   // filesystem.cpp
+extern const VfsOps fatfs_vfs_ops;   // fatfs_integration.cpp
+
+// Mount management
+void vfs_init();
+int vfs_mount(const char* path, const VfsOps* ops);
+int vfs_unmount(const char* path);
+bool vfs_is_mounted(const char* path);
+const VfsMount* vfs_get_mount(int index);
+const VfsOps* vfs_get_ops(const char* path);
+int vfs_drop_cache(const char* path);
+int vfs_sync();
+
+// Filesystem state is not reentrant: threads take this lock around any
+// filesystem use. Shell commands hold it while they run.
+void vfs_lock();
+void vfs_unlock();
+
+// Start the thread that writes dirty cache pages back every few seconds
+// while no shell command runs
+void vfs_start_writeback();
+
+// Path handling
+int vfs_normalize(const char* path, char* out);
+int vfs_chdir(const char* path);
+const char* vfs_getcwd();
+
+// Namespace operations
+int vfs_stat(const char* path, VfsDirEntry* info);
+int vfs_mkdir(const char* path);
+int vfs_unlink(const char* path);
+int vfs_rmdir(const char* path);
+int vfs_copy(const char* src, const char* dst);
+
+// File descriptors
+int vfs_open(const char* path, int flags);
+int vfs_close(int fd);
+int vfs_read(int fd, void* buf, vic_uint32 len);
+int vfs_write(int fd, const void* buf, vic_uint32 len);
+int vfs_seek(int fd, vic_uint32 offset);
+int vfs_size(int fd);
+int vfs_fsync(int fd);
+int vfs_stream(int fd, VfsSink sink);
+
+// Directory descriptors
+int vfs_opendir(const char* path);
+int vfs_readdir(int fd, VfsDirEntry* entry);
+
+// Error text for a VFS result code
+const char* vfs_strerror(int err);
+
+#endif // VFS_H
@@ -1,15 +1,15 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "vfs.h"
 
 // Forward declarations from kernel.cpp
 void kprint(const char* str);
 void kputchar(char c);
 extern "C" void clear_screen();
 
-// Forward declarations for filesystem
-const char* fs_read(const char* path);
-vic_uint32 fs_touch(const char* path, const char* content);
+// Forward declaration from vshellhandler.cpp
+const char* vshell_arg(int n);
 
 // Editor state
 #define VNANO_MAX_BUFFER_SIZE 4096
@@ -55,23 +55,17 @@ void vnano_init(const char* filename) {
     vnano_strcpy(editor_filename, filename);
 
     // Load file content if it exists
-    const char* content = fs_read(filename);
-    if (content) {
-        // Copy file content to editor buffer
-        vic_size_t content_len = vnano_strlen(content);
-        if (content_len >= VNANO_MAX_BUFFER_SIZE) {
-            content_len = VNANO_MAX_BUFFER_SIZE - 1;
+    editor_buffer[0] = '\0';
+    int fd = vfs_open(filename, VFS_O_READ);
+    if (fd >= 0) {
+        // Read file content into the editor buffer
+        int content_len = vfs_read(fd, editor_buffer, VNANO_MAX_BUFFER_SIZE - 1);
+        vfs_close(fd);
+
+        if (content_len > 0) {
+            editor_buffer[content_len] = '\0';
+            editor_length = content_len;
         }
-
-        for (vic_size_t i = 0; i < content_len; i++) {
-            editor_buffer[i] = content[i];
-        }
-
-        editor_buffer[content_len] = '\0';
-        editor_length = content_len;
-    } else {
-        // New file
-        editor_buffer[0] = '\0';
     }
 }
 
@@ -295,8 +289,14 @@ void vnano_move_cursor(int direction) {
 
 // Save file
 void vnano_save() {
-    fs_touch(editor_filename, editor_buffer);
-    editor_modified = false;
+    int fd = vfs_open(editor_filename, VFS_O_WRITE | VFS_O_CREATE | VFS_O_TRUNC);
+    if (fd >= 0) {
+        int written = vfs_write(fd, editor_buffer, editor_length);
+        int closed = vfs_close(fd);
+        if (written == (int)editor_length && closed == VFS_OK) {
+            editor_modified = false;
+        }
+    }
     vnano_refresh();
 }
 
@@ -366,23 +366,8 @@ void vnano_edit(const char* filename) {
 }
 
 // This function would be called from vshellhandler.cpp
-void process_vnano(const char* command) {
-    char filename[256];
-
-    // Extract filename from command
-    const char* cmd_ptr = command + 6; // Skip "vnano "
-
-    // Skip spaces
-    while (*cmd_ptr == ' ') {
-        cmd_ptr++;
-    }
-
-    // Copy filename
-    vic_size_t i = 0;
-    while (*cmd_ptr && *cmd_ptr != ' ' && i < 255) {
-        filename[i++] = *cmd_ptr++;
-    }
-    filename[i] = '\0';
+void process_vnano(const char* /* command */) {
+    const char* filename = vshell_arg(1);
 
     if (filename[0] == '\0') {
         kprint("Usage: vnano <filename>\n");
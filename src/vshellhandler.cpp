@@ -1,39 +1,53 @@
 #include <stdint.h>
 #include "vstdint.h"
 #include <stddef.h>
+#include "vfs.h"
+#include "arena.h"
 
 // Forward declarations from kernel.cpp
 void kprint(const char* str);
 extern "C" void clear_screen();
 
+void kputchar(char c);
+
 // Forward declarations from filesystem.cpp (in-memory FS)
 void fs_init();
-bool fs_cd(const char* path);
-void fs_ls(const char* path);
-vic_uint32 fs_mkdir(const char* path);
-vic_uint32 fs_touch(const char* path, const char* content);
-const char* fs_read(const char* path);
-const char* fs_pwd();
-
-// Forward declarations from fatfs_integration.h
-int fatfs_initialize();
-int fatfs_mkdir(const char* path);
-void fatfs_list_directory(const char* path);
-int fatfs_write_file(const char* path, const char* content, vic_size_t size);
-int fatfs_read_file(const char* path, char* buffer, vic_size_t buffer_size, vic_size_t* bytes_read);
+int fs_snapshot(const char* path);
+int fs_restore(const char* path);
+
+// Forward declarations from fs_log.cpp
+int fs_log_attach(const char* log_path, const char* image_path);
+int fs_log_detach();
+int fs_log_commit();
+int fs_log_checkpoint();
+bool fs_log_is_active();
+
+// Where mount-fatfs attaches the disk
+#define FATFS_MOUNT_POINT "/disk"
+
+// Default image used by fs-snapshot and fs-restore
+#define FS_SNAPSHOT_DEFAULT FATFS_MOUNT_POINT "/vicos.img"
+
+// Write-ahead log kept next to the image while the disk is mounted
+#define FS_LOG_DEFAULT FATFS_MOUNT_POINT "/vicos.log"
 
 // Forward declaration from vnano.cpp
 void process_vnano(const char* command);
 
-// Forward declaration from fatfs_installer.cpp
-void process_fatfs_install(const char* command);
+// Forward declaration from real_installer.cpp
+void process_perm_install(const char* command);
+
+// Forward declaration from meminfo.cpp
+void process_meminfo(const char* command);
+
+// Forward declaration from timer.cpp
+void process_uptime(const char* command);
 
-// Flag to indicate if we're using FatFS or the in-memory filesystem
-bool using_fatfs = false;
+// Forward declaration from sched.cpp
+void process_ps(const char* command);
 
-// Buffer for file reading with FatFS
-#define MAX_FILE_BUFFER 4096
-char file_read_buffer[MAX_FILE_BUFFER];
+// Last byte cat pushed to the console
+char cat_last_char = '\0';
 
 // String operations
 bool str_equals(const char* s1, const char* s2) {
@@ -62,42 +76,104 @@ vic_size_t vsh_strlen(const char* str) {
     return len;
 }
 
-// Extract n-th argument from a command line
-void get_argument(const char* command, int arg_num, char* buffer, vic_size_t buffer_size) {
-    // Skip leading spaces
-    while (*command == ' ') {
-        command++;
-    }
+// Scratch memory for the command being run: tokens, expanded paths and
+// temporary buffers. Reset after every command.
+#define VSHELL_ARENA_SIZE 16384
 
-    // Skip command name (first argument)
-    while (*command && *command != ' ') {
-        command++;
+char vshell_arena_memory[VSHELL_ARENA_SIZE];
+Arena vshell_arena;
+
+// The current command line, split once; token 0 is the command name
+int vshell_argc = 0;
+char** vshell_argv = nullptr;
+const char** vshell_tails = nullptr;    // Line from each token on
+
+// Split command into tokens in the arena
+static void vshell_parse(const char* command) {
+    vshell_argc = 0;
+
+    // Count first so the arrays are sized exactly
+    int count = 0;
+    for (const char* p = command; *p;) {
+        while (*p == ' ') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        count++;
+        while (*p && *p != ' ') {
+            p++;
+        }
     }
 
-    // Skip spaces between arguments
-    while (*command == ' ') {
-        command++;
+    vshell_argv = (char**)arena_alloc(&vshell_arena, count * sizeof(char*));
+    vshell_tails = (const char**)arena_alloc(&vshell_arena, count * sizeof(const char*));
+    if (!vshell_argv || !vshell_tails) {
+        return;
     }
 
-    // Find the requested argument
-    for (int i = 1; i < arg_num; i++) {
-        // Skip current argument
-        while (*command && *command != ' ') {
-            command++;
+    const char* p = command;
+    while (vshell_argc < count) {
+        while (*p == ' ') {
+            p++;
+        }
+        const char* token = p;
+        while (*p && *p != ' ') {
+            p++;
         }
 
-        // Skip spaces to next argument
-        while (*command == ' ') {
-            command++;
+        char* copy = arena_strndup(&vshell_arena, token, (vic_uint32)(p - token));
+        if (!copy) {
+            return;
         }
+        vshell_argv[vshell_argc] = copy;
+        vshell_tails[vshell_argc] = token;
+        vshell_argc++;
     }
+}
 
-    // Extract the argument
-    vic_size_t i = 0;
-    while (*command && *command != ' ' && i < buffer_size - 1) {
-        buffer[i++] = *command++;
-    }
-    buffer[i] = '\0';
+// n-th argument of the current command, "" when missing
+const char* vshell_arg(int n) {
+    return (n < vshell_argc) ? vshell_argv[n] : "";
+}
+
+// Rest of the command line from the n-th argument on, "" when missing
+const char* vshell_arg_tail(int n) {
+    return (n < vshell_argc) ? vshell_tails[n] : "";
+}
+
+// Scratch memory that lives until the current command finishes
+void* vshell_alloc(vic_uint32 size) {
+    return arena_alloc(&vshell_arena, size);
+}
+
+// Print "Error: <what> <path>: <reason>"
+void print_vfs_error(const char* what, const char* path, int err) {
+    kprint("Error: ");
+    kprint(what);
+    kprint(" ");
+    kprint(path);
+    kprint(": ");
+    kprint(vfs_strerror(err));
+    kprint("\n");
+}
+
+// Print an unsigned number
+void print_number(vic_uint32 value) {
+    char digits[12];
+    int idx = 0;
+    do {
+        digits[idx++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    char out[12];
+    for (int i = 0; i < idx; i++) {
+        out[i] = digits[idx - i - 1];
+    }
+    out[idx] = '\0';
+    kprint(out);
 }
 
 // Print help information
@@ -113,12 +189,22 @@ void display_help() {
     kprint("  ls           - List directory contents\n");
     kprint("  cd           - Change directory\n");
     kprint("  mkdir        - Create a directory\n");
+    kprint("  rmdir        - Remove an empty directory\n");
     kprint("  touch        - Create or update a file\n");
+    kprint("  append       - Add a line to the end of a file\n");
+    kprint("  rm           - Remove a file\n");
+    kprint("  cp           - Copy a file\n");
     kprint("  cat          - Display file contents\n");
     kprint("  vnano        - Edit files with the VNano editor\n");
     kprint("System Commands:\n");
-    kprint("  mount-fatfs  - Mount FatFS filesystem\n");
-    kprint("  umount-fatfs - Unmount FatFS, switch to RAM filesystem\n");
+    kprint("  mount-fatfs  - Mount the FatFS disk at /disk\n");
+    kprint("  umount-fatfs - Unmount the FatFS disk from /disk\n");
+    kprint("  fs-snapshot  - Save the RAM filesystem to an image (default /disk/vicos.img)\n");
+    kprint("  fs-restore   - Load the RAM filesystem from an image\n");
+    kprint("  fs-checkpoint - Fold the change log into the disk image\n");
+    kprint("  meminfo      - Show kernel memory use by subsystem\n");
+    kprint("  uptime       - Show time since boot and idle time\n");
+    kprint("  ps           - List kernel threads\n");
     kprint("  perm-install - Install VicOS to a permanent storage device\n");
 }
 
@@ -127,10 +213,9 @@ void display_about() {
     kprint("VicOS - A simple operating system\n");
     kprint("Created as a learning project\n");
     kprint("Features a basic VShell command interpreter\n");
-    if (using_fatfs) {
-        kprint("Currently using FatFS for persistent storage\n");
-    } else {
-        kprint("Currently using in-memory filesystem\n");
+    kprint("In-memory filesystem at /\n");
+    if (vfs_is_mounted(FATFS_MOUNT_POINT)) {
+        kprint("FatFS persistent storage at /disk\n");
     }
     kprint("Now with permanent installation capabilities!\n");
 }
@@ -145,115 +230,81 @@ void display_version() {
 }
 
 // Process echo command
-void process_echo(const char* command) {
-    // Skip over "echo "
-    const char* message = command + 5;
-
-    // Skip leading spaces
-    while (*message == ' ') {
-        message++;
-    }
-
+void process_echo(const char* /* command */) {
     // Print the message
-    kprint(message);
+    kprint(vshell_arg_tail(1));
     kprint("\n");
 }
 
+// Console sink for vfs_stream
+void cat_sink(const char* data, vic_uint32 len) {
+    for (vic_uint32 i = 0; i < len; i++) {
+        kputchar(data[i]);
+    }
+    if (len > 0) {
+        cat_last_char = data[len - 1];
+    }
+}
+
 // Process cat command
-void process_cat(const char* command) {
-    char filename[256];
-    get_argument(command, 1, filename, sizeof(filename));
+void process_cat(const char* /* command */) {
+    const char* filename = vshell_arg(1);
 
     if (filename[0] == '\0') {
         kprint("Usage: cat <filename>\n");
         return;
     }
 
-    if (using_fatfs) {
-        // Use FatFS to read the file
-        vic_size_t bytes_read;
-        int result = fatfs_read_file(filename, file_read_buffer, MAX_FILE_BUFFER, &bytes_read);
-
-        if (result < 0) {
-            kprint("Error: File not found or couldn't be read: ");
-            kprint(filename);
-            kprint("\n");
-            return;
-        }
+    int fd = vfs_open(filename, VFS_O_READ);
+    if (fd < 0) {
+        print_vfs_error("cannot read", filename, fd);
+        return;
+    }
 
-        // Print file content
-        kprint(file_read_buffer);
+    // Stream the file straight to the console
+    cat_last_char = '\0';
+    int streamed = vfs_stream(fd, cat_sink);
+    vfs_close(fd);
 
-        // Add newline if content doesn't end with one
-        if (bytes_read > 0 && file_read_buffer[bytes_read - 1] != '\n') {
-            kprint("\n");
-        }
-    } else {
-        // Use in-memory filesystem
-        const char* content = fs_read(filename);
-        if (content) {
-            kprint(content);
-            // Add newline if content doesn't end with one
-            if (vsh_strlen(content) > 0 && content[vsh_strlen(content) - 1] != '\n') {
-                kprint("\n");
-            }
-        } else {
-            kprint("Error: File not found: ");
-            kprint(filename);
-            kprint("\n");
-        }
+    // Add newline if content doesn't end with one
+    if (streamed > 0 && cat_last_char != '\n') {
+        kprint("\n");
+    }
+    if (streamed < 0) {
+        print_vfs_error("cannot read", filename, streamed);
     }
 }
 
 // Process touch command
-void process_touch(const char* command) {
-    char filename[256];
-    get_argument(command, 1, filename, sizeof(filename));
+void process_touch(const char* /* command */) {
+    const char* filename = vshell_arg(1);
 
     if (filename[0] == '\0') {
         kprint("Usage: touch <filename> [content]\n");
         return;
     }
 
-    // Check if content is provided
-    const char* content_ptr = command + 6; // Skip "touch "
+    // Content, if any, is the rest of the line after the filename
+    const char* content_ptr = vshell_arg_tail(2);
 
-    // Skip filename
-    while (*content_ptr && *content_ptr != ' ') {
-        content_ptr++;
+    int fd = vfs_open(filename, VFS_O_WRITE | VFS_O_CREATE | VFS_O_TRUNC);
+    if (fd < 0) {
+        print_vfs_error("cannot create", filename, fd);
+        return;
     }
 
-    // Skip spaces after filename
-    while (*content_ptr == ' ') {
-        content_ptr++;
-    }
+    vic_uint32 len = vsh_strlen(content_ptr);
+    int written = vfs_write(fd, content_ptr, len);
 
-    if (using_fatfs) {
-        // Use FatFS to create/update the file
-        int result;
-        if (*content_ptr) {
-            // Content provided
-            result = fatfs_write_file(filename, content_ptr, vsh_strlen(content_ptr));
-        } else {
-            // No content, pass empty string
-            result = fatfs_write_file(filename, "", 0);
-        }
+    // Closing writes the cached pages back, which can fail too
+    int closed = vfs_close(fd);
+    if (written >= 0 && closed < 0) {
+        written = closed;
+    }
 
-        if (result < 0) {
-            kprint("Error: Failed to create/update file: ");
-            kprint(filename);
-            kprint("\n");
-            return;
-        }
-    } else {
-        // Use in-memory filesystem
-        if (*content_ptr) {
-            // Content provided
-            fs_touch(filename, content_ptr);
-        } else {
-            // No content, pass empty string
-            fs_touch(filename, "");
-        }
+    if (written < 0 || (vic_uint32)written != len) {
+        print_vfs_error("cannot write", filename, written < 0 ? written : VFS_ERR_NO_SPACE);
+        return;
     }
 
     kprint("File created/updated: ");
@@ -261,33 +312,75 @@ void process_touch(const char* command) {
     kprint("\n");
 }
 
+// Process append command: add one line to the end of a file
+void process_append(const char* /* command */) {
+    const char* filename = vshell_arg(1);
+
+    if (filename[0] == '\0') {
+        kprint("Usage: append <filename> <text>\n");
+        return;
+    }
+
+    // Text starts after the filename
+    const char* text = vshell_arg_tail(2);
+
+    int fd = vfs_open(filename, VFS_O_WRITE | VFS_O_CREATE | VFS_O_APPEND);
+    if (fd < 0) {
+        print_vfs_error("cannot open", filename, fd);
+        return;
+    }
+
+    vic_uint32 len = vsh_strlen(text);
+    int written = vfs_write(fd, text, len);
+    if (written >= 0 && (vic_uint32)written == len) {
+        written = vfs_write(fd, "\n", 1);
+        len = 1;
+    }
+
+    int closed = vfs_close(fd);
+    if (written >= 0 && closed < 0) {
+        written = closed;
+    }
+
+    if (written < 0 || (vic_uint32)written != len) {
+        print_vfs_error("cannot write", filename, written < 0 ? written : VFS_ERR_NO_SPACE);
+    }
+}
+
+// Process cp command
+void process_cp(const char* /* command */) {
+    const char* src = vshell_arg(1);
+    const char* dst = vshell_arg(2);
+
+    if (src[0] == '\0' || dst[0] == '\0') {
+        kprint("Usage: cp <source> <destination>\n");
+        return;
+    }
+
+    int result = vfs_copy(src, dst);
+    if (result < 0) {
+        print_vfs_error("cannot copy", src, result);
+        return;
+    }
+
+    kprint("File copied: ");
+    kprint(dst);
+    kprint("\n");
+}
+
 // Process mkdir command
-void process_mkdir(const char* command) {
-    char dirname[256];
-    get_argument(command, 1, dirname, sizeof(dirname));
+void process_mkdir(const char* /* command */) {
+    const char* dirname = vshell_arg(1);
 
     if (dirname[0] == '\0') {
         kprint("Usage: mkdir <directory>\n");
         return;
     }
 
-    if (using_fatfs) {
-        // Use FatFS to create directory
-        int result = fatfs_mkdir(dirname);
-        if (result < 0) {
-            kprint("Error: Failed to create directory: ");
-            kprint(dirname);
-            kprint("\n");
-            return;
-        }
-    } else {
-        // Use in-memory filesystem
-        if (fs_mkdir(dirname) == (vic_uint32)-1) {
-            kprint("Error: Failed to create directory: ");
-            kprint(dirname);
-            kprint("\n");
-            return;
-        }
+    int result = vfs_mkdir(dirname);
+    if (result < 0) {
+        print_vfs_error("cannot create directory", dirname, result);
+        return;
     }
 
     kprint("Directory created: ");
@@ -295,104 +388,258 @@ void process_mkdir(const char* command) {
     kprint("\n");
 }
 
-// Process ls command
-void process_ls(const char* command) {
-    char path[256];
-    get_argument(command, 1, path, sizeof(path));
+// Process rm command
+void process_rm(const char* /* command */) {
+    const char* filename = vshell_arg(1);
 
-    // If no path provided, use current directory
-    if (path[0] == '\0') {
-        if (using_fatfs) {
-            fatfs_list_directory(".");
-        } else {
-            fs_ls(".");
+    if (filename[0] == '\0') {
+        kprint("Usage: rm <filename>\n");
+        return;
+    }
+
+    int result = vfs_unlink(filename);
+    if (result < 0) {
+        print_vfs_error("cannot remove", filename, result);
+        return;
+    }
+
+    kprint("File removed: ");
+    kprint(filename);
+    kprint("\n");
+}
+
+// Process rmdir command
+void process_rmdir(const char* /* command */) {
+    const char* dirname = vshell_arg(1);
+
+    if (dirname[0] == '\0') {
+        kprint("Usage: rmdir <directory>\n");
+        return;
+    }
+
+    int result = vfs_rmdir(dirname);
+    if (result < 0) {
+        print_vfs_error("cannot remove directory", dirname, result);
+        return;
+    }
+
+    kprint("Directory removed: ");
+    kprint(dirname);
+    kprint("\n");
+}
+
+// Print the entries of an open directory of one type
+// Returns the number printed
+int list_entries(const char* path, vic_uint8 type) {
+    int fd = vfs_opendir(path);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int count = 0;
+    VfsDirEntry entry;
+    while (vfs_readdir(fd, &entry) > 0) {
+        if (entry.type != type) {
+            continue;
         }
-    } else {
-        if (using_fatfs) {
-            fatfs_list_directory(path);
+
+        count++;
+        if (type == VFS_TYPE_DIRECTORY) {
+            kprint("[DIR] ");
+            kprint(entry.name);
+            kprint("\n");
         } else {
-            fs_ls(path);
+            kprint("[FILE] ");
+            kprint(entry.name);
+            kprint(" (");
+            print_number(entry.size);
+            kprint(" bytes)\n");
         }
     }
+
+    vfs_close(fd);
+    return count;
 }
 
-// Process cd command
-void process_cd(const char* command) {
-    char path[256];
-    get_argument(command, 1, path, sizeof(path));
+// Process ls command
+void process_ls(const char* /* command */) {
+    const char* path = vshell_arg(1);
+
+    // If no path provided, use current directory
+    char* canonical = (char*)vshell_alloc(VFS_MAX_PATH);
+    int result = canonical ? vfs_normalize(path[0] ? path : ".", canonical) : VFS_ERR_NO_SPACE;
+    if (result >= 0) {
+        // Probe first so errors show before the header
+        result = vfs_opendir(canonical);
+    }
+    if (result < 0) {
+        print_vfs_error("cannot list", path[0] ? path : ".", result);
+        return;
+    }
+    vfs_close(result);
+
+    kprint("Contents of ");
+    kprint(canonical);
+    kprint(":\n");
 
-    if (using_fatfs) {
-        // FatFS doesn't track current directory in the same way
-        // We would need to implement this separately
-        kprint("Note: When using FatFS, only absolute paths are fully supported.\n");
+    // First, list directories, then files
+    int found = list_entries(canonical, VFS_TYPE_DIRECTORY);
+    found += list_entries(canonical, VFS_TYPE_FILE);
+
+    if (found == 0) {
+        kprint("  [Empty directory]\n");
     }
+}
 
+// Process cd command
+void process_cd(const char* /* command */) {
+    const char* path = vshell_arg(1);
+
+    // No argument, change to root
     if (path[0] == '\0') {
-        // No argument, change to root
-        if (!using_fatfs) {
-            fs_cd("/");
-        }
-    } else {
-        if (!using_fatfs) {
-            fs_cd(path);
-        }
+        path = "/";
+    }
+
+    int result = vfs_chdir(path);
+    if (result < 0) {
+        print_vfs_error("cannot change to", path, result);
     }
 }
 
 // Process pwd command
 void process_pwd(const char* /* command */) {
-    if (using_fatfs) {
-        // FatFS doesn't track current directory in the same way
-        kprint("Current directory: / (root)\n");
-    } else {
-        kprint("Current directory: ");
-        kprint(fs_pwd());
-        kprint("\n");
-    }
+    kprint("Current directory: ");
+    kprint(vfs_getcwd());
+    kprint("\n");
 }
 
 // Process mounting FatFS
 void process_mount_fatfs(const char* /* command */) {
-    if (using_fatfs) {
-        kprint("FatFS is already mounted.\n");
+    if (vfs_is_mounted(FATFS_MOUNT_POINT)) {
+        kprint("FatFS is already mounted at " FATFS_MOUNT_POINT ".\n");
         return;
     }
 
     kprint("Attempting to mount FatFS...\n");
-    int result = fatfs_initialize();
 
+    // The mount point lives in the RAM filesystem
+    int result = vfs_mkdir(FATFS_MOUNT_POINT);
+    if (result < 0 && result != VFS_ERR_EXISTS) {
+        print_vfs_error("cannot create", FATFS_MOUNT_POINT, result);
+        return;
+    }
+
+    result = vfs_mount(FATFS_MOUNT_POINT, &fatfs_vfs_ops);
     if (result < 0) {
-        kprint("Failed to mount FatFS. Continuing with in-memory filesystem.\n");
+        print_vfs_error("cannot mount FatFS at", FATFS_MOUNT_POINT, result);
         return;
     }
 
-    using_fatfs = true;
-    kprint("FatFS mounted successfully. Now using persistent storage.\n");
+    kprint("FatFS mounted at " FATFS_MOUNT_POINT ".\n");
+
+    // Bring back the saved tree and keep logging changes to the disk
+    result = fs_log_attach(FS_LOG_DEFAULT, FS_SNAPSHOT_DEFAULT);
+    if (result < 0) {
+        print_vfs_error("cannot attach change log", FS_LOG_DEFAULT, result);
+        return;
+    }
+    kprint("Filesystem persisted to " FS_SNAPSHOT_DEFAULT " (");
+    print_number(result);
+    kprint(" log records replayed).\n");
 }
 
 // Process unmounting FatFS
 void process_umount_fatfs(const char* /* command */) {
-    if (!using_fatfs) {
+    if (!vfs_is_mounted(FATFS_MOUNT_POINT)) {
         kprint("FatFS is not currently mounted.\n");
         return;
     }
 
-    // In a more complete implementation, we would call a function to unmount FatFS
-    using_fatfs = false;
-    kprint("Switched back to in-memory filesystem.\n");
+    int result = fs_log_detach();
+    if (result < 0) {
+        print_vfs_error("cannot commit change log", FS_LOG_DEFAULT, result);
+    }
+
+    result = vfs_unmount(FATFS_MOUNT_POINT);
+    if (result < 0) {
+        print_vfs_error("cannot unmount", FATFS_MOUNT_POINT, result);
+        return;
+    }
+
+    kprint("FatFS unmounted from " FATFS_MOUNT_POINT ".\n");
+}
+
+// Process fs-snapshot command
+void process_fs_snapshot(const char* /* command */) {
+    const char* path = vshell_arg(1);
+    const char* image = (path[0] != '\0') ? path : FS_SNAPSHOT_DEFAULT;
+
+    int result = fs_snapshot(image);
+    if (result < 0) {
+        print_vfs_error("cannot write snapshot", image, result);
+        return;
+    }
+
+    kprint("Snapshot saved to ");
+    kprint(image);
+    kprint("\n");
+}
+
+// Process fs-restore command
+void process_fs_restore(const char* /* command */) {
+    const char* path = vshell_arg(1);
+    const char* image = (path[0] != '\0') ? path : FS_SNAPSHOT_DEFAULT;
+
+    int result = fs_restore(image);
+    if (result < 0) {
+        print_vfs_error("cannot restore snapshot", image, result);
+        return;
+    }
+
+    kprint("Filesystem restored from ");
+    kprint(image);
+    kprint("\n");
+
+    // The log described the old tree; start a new one from this one
+    if (fs_log_is_active()) {
+        result = fs_log_checkpoint();
+        if (result < 0) {
+            print_vfs_error("cannot checkpoint to", FS_SNAPSHOT_DEFAULT, result);
+        }
+    }
+}
+
+// Process fs-checkpoint command
+void process_fs_checkpoint(const char* /* command */) {
+    if (!fs_log_is_active()) {
+        kprint("No change log is attached; mount the disk first.\n");
+        return;
+    }
+
+    int result = fs_log_checkpoint();
+    if (result < 0) {
+        print_vfs_error("cannot checkpoint to", FS_SNAPSHOT_DEFAULT, result);
+        return;
+    }
+
+    kprint("Checkpoint written to " FS_SNAPSHOT_DEFAULT "\n");
 }
 
 // Initialize VShell
 void vshell_init() {
+    arena_init(&vshell_arena, vshell_arena_memory, sizeof(vshell_arena_memory));
+
     // Display welcome message
     kprint("Welcome to VicOS! You have now entered VShell.\n");
     kprint("Type 'help' for available commands.\n");
 
-    // Initialize in-memory filesystem
+    // Initialize in-memory filesystem and make it the root
     fs_init();
+    vfs_init();
+    vfs_mount("/", &ramfs_vfs_ops);
 
-    // By default, start with in-memory filesystem
-    using_fatfs = false;
+    // Pick up the tree saved on disk, replaying its change log
+    process_mount_fatfs("mount-fatfs");
 }
 
 // Execute a command
@@ -407,55 +654,105 @@ void vshell_execute_command(const char* command) {
         return;
     }
 
+    // Split the line once; handlers read their arguments from the arena
+    vshell_parse(command);
+    const char* name = vshell_arg(0);
+
+    // Keep background writeback out of the filesystem while we run;
+    // commands that wait for the user drop the lock while they wait
+    vfs_lock();
+
     // Process commands
-    if (str_equals(command, "help")) {
+    if (str_equals(name, "help")) {
         display_help();
     }
-    else if (str_equals(command, "clear")) {
+    else if (str_equals(name, "clear")) {
         clear_screen();
     }
-    else if (str_equals(command, "about")) {
+    else if (str_equals(name, "about")) {
         display_about();
     }
-    else if (str_equals(command, "version")) {
+    else if (str_equals(name, "version")) {
         display_version();
     }
-    else if (str_starts_with(command, "echo ")) {
+    else if (str_equals(name, "echo")) {
         process_echo(command);
     }
-    else if (str_equals(command, "pwd")) {
+    else if (str_equals(name, "pwd")) {
         process_pwd(command);
     }
-    else if (str_starts_with(command, "cd")) {
+    else if (str_equals(name, "cd")) {
         process_cd(command);
     }
-    else if (str_starts_with(command, "ls")) {
+    else if (str_equals(name, "ls")) {
         process_ls(command);
     }
-    else if (str_starts_with(command, "mkdir ")) {
+    else if (str_equals(name, "mkdir")) {
         process_mkdir(command);
     }
-    else if (str_starts_with(command, "touch ")) {
+    else if (str_equals(name, "rmdir")) {
+        process_rmdir(command);
+    }
+    else if (str_equals(name, "rm")) {
+        process_rm(command);
+    }
+    else if (str_equals(name, "touch")) {
         process_touch(command);
     }
-    else if (str_starts_with(command, "cat ")) {
+    else if (str_equals(name, "append")) {
+        process_append(command);
+    }
+    else if (str_equals(name, "cp")) {
+        process_cp(command);
+    }
+    else if (str_equals(name, "cat")) {
         process_cat(command);
     }
-    else if (str_starts_with(command, "vnano ")) {
+    else if (str_equals(name, "vnano")) {
         process_vnano(command);
     }
-    else if (str_equals(command, "perm-install")) {
-        process_fatfs_install(command);
+    else if (str_equals(name, "meminfo")) {
+        process_meminfo(command);
+    }
+    else if (str_equals(name, "uptime")) {
+        process_uptime(command);
+    }
+    else if (str_equals(name, "ps")) {
+        process_ps(command);
     }
-    else if (str_equals(command, "mount-fatfs")) {
+    else if (str_equals(name, "perm-install")) {
+        process_perm_install(command);
+    }
+    else if (str_equals(name, "mount-fatfs")) {
         process_mount_fatfs(command);
     }
-    else if (str_equals(command, "umount-fatfs")) {
+    else if (str_equals(name, "umount-fatfs")) {
         process_umount_fatfs(command);
     }
+    else if (str_equals(name, "fs-snapshot")) {
+        process_fs_snapshot(command);
+    }
+    else if (str_equals(name, "fs-restore")) {
+        process_fs_restore(command);
+    }
+    else if (str_equals(name, "fs-checkpoint")) {
+        process_fs_checkpoint(command);
+    }
     else {
         kprint("Unknown command: ");
         kprint(command);
         kprint("\nType 'help' for available commands.\n");
     }
+
+    // Group commit: whatever the command changed reaches the log in one append
+    int result = fs_log_commit();
+    if (result < 0) {
+        print_vfs_error("cannot commit change log", FS_LOG_DEFAULT, result);
+    }
+
+    vfs_unlock();
+
+    // Everything the command allocated goes at once
+    vshell_argc = 0;
+    arena_reset(&vshell_arena);
 }